@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Allocations"
+
+// #define LOG_NDEBUG 0
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <android/log.h>
+#include <log/log.h>
+#include "Allocations.h"
+#include "Metrics.h"
+
+namespace inputhook {
+namespace alloc {
+
+namespace {
+    thread_local uint64_t threadCount{}; //!< Trivially initialised, so touching it never allocates itself
+
+    struct PathCounters {
+        metrics::Counter checks;
+        metrics::Counter allocations;
+        std::atomic_bool reported{}; //!< Only the first offence is logged to keep the log usable
+    };
+
+    std::array<PathCounters, static_cast<size_t>(Path::Count)> paths;
+    std::atomic_bool strictMode{};
+
+    constexpr const char *PathNames[]{"filterEvent", "notifyMotionState", "tick"};
+}
+
+uint64_t ThreadCount() {
+    return threadCount;
+}
+
+void SetStrict(bool strict) {
+    strictMode.store(strict, std::memory_order_relaxed);
+}
+
+void Check(Path path, uint64_t allocations) {
+    auto &counters{paths[static_cast<size_t>(path)]};
+    counters.checks.Add();
+    if (!allocations)
+        return;
+
+    counters.allocations.Add(allocations);
+    LOG_ALWAYS_FATAL_IF(strictMode.load(std::memory_order_relaxed), "%s made %" PRIu64 " heap allocations", PathNames[static_cast<size_t>(path)], allocations);
+    if (!counters.reported.exchange(true, std::memory_order_relaxed))
+        ALOGE("%s made %" PRIu64 " heap allocations, further ones are only counted", PathNames[static_cast<size_t>(path)], allocations);
+}
+
+uint64_t Allocations(Path path) {
+    return paths[static_cast<size_t>(path)].allocations.Sum();
+}
+
+void Dump(int fd) {
+    if (!Counting)
+        return;
+
+    dprintf(fd, "Heap allocations (this thread: %" PRIu64 "):\n", ThreadCount());
+    dprintf(fd, "  %-20s %12s %12s\n", "", "calls", "allocations");
+    for (size_t i{}; i < paths.size(); i++)
+        dprintf(fd, "  %-20s %12" PRIu64 " %12" PRIu64 "\n", PathNames[i], paths[i].checks.Sum(), paths[i].allocations.Sum());
+}
+
+} // namespace alloc
+} // namespace inputhook
+
+#if defined(INPUTHOOK_ALLOC_COUNTING)
+/*
+ * Replacements of the global allocation functions, the remaining forms (nothrow and array deletes, sized deletes) are
+ * implemented by the standard library in terms of these
+ */
+void *operator new(size_t size) {
+    inputhook::alloc::threadCount++;
+    if (void *ptr{malloc(size ? size : 1)})
+        return ptr;
+    LOG_ALWAYS_FATAL("Out of memory allocating %zu bytes", size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    inputhook::alloc::threadCount++;
+    void *ptr{};
+    auto align{std::max(static_cast<size_t>(alignment), sizeof(void *))};
+    if (!posix_memalign(&ptr, align, size ? size : 1))
+        return ptr;
+    LOG_ALWAYS_FATAL("Out of memory allocating %zu bytes aligned to %zu", size, align);
+}
+
+void operator delete(void *ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    free(ptr);
+}
+#endif
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_ALLOCATIONS_H
+#define INPUTHOOK_ALLOCATIONS_H
+
+#include <cstdint>
+
+namespace inputhook {
+namespace alloc {
+
+/**
+ * @brief If the global allocator is interposed to count heap allocations per thread, set SOONG_CONFIG_inputhook_alloc_counting=true for this
+ * @note This only covers operator new, which is what every container and std::function use, plain malloc() calls aren't counted
+ */
+#if defined(INPUTHOOK_ALLOC_COUNTING)
+constexpr bool Counting{true};
+#else
+constexpr bool Counting{false};
+#endif
+
+//! The paths that mustn't allocate once a device is registered
+enum class Path : uint8_t {
+    FilterEvent,
+    NotifyMotionState,
+    Tick, //!< A single RsMouse cursor tick
+    Count,
+};
+
+//! The amount of heap allocations the calling thread has made so far, always 0 unless counting
+uint64_t ThreadCount();
+
+//! Makes any offence abort rather than only being counted, set from persist.vendor.inputhook.alloc.strict once it's loaded
+void SetStrict(bool strict);
+
+//! Records that |path| made |allocations| heap allocations, this aborts in strict mode if there are any
+void Check(Path path, uint64_t allocations);
+
+//! The total amount of heap allocations made on the given path so far
+uint64_t Allocations(Path path);
+
+/**
+ * @brief Checks that the calling thread doesn't allocate until this goes out of scope, this compiles to nothing unless counting
+ */
+class Scope {
+  private:
+    Path mPath;
+    uint64_t mStart;
+
+  public:
+    explicit Scope(Path path) : mPath(path), mStart(Counting ? ThreadCount() : 0) {}
+
+    ~Scope() {
+        if (Counting)
+            Check(mPath, ThreadCount() - mStart);
+    }
+
+    Scope(const Scope &) = delete;
+
+    Scope &operator=(const Scope &) = delete;
+};
+
+void Dump(int fd);
+
+} // namespace alloc
+} // namespace inputhook
+
+#endif // INPUTHOOK_ALLOCATIONS_H
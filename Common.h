@@ -31,6 +31,7 @@ using ::vendor::nvidia::hardware::shieldtech::inputflinger::V2_0::Response;
 using ::vendor::nvidia::hardware::shieldtech::inputflinger::V2_0::NewDevice;
 using ::android::hardware::hidl_handle;
 using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
 using ::android::hardware::Return;
 using ::android::hardware::Void;
 using ::android::status_t;
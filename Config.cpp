@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include "Config.h"
+
+namespace inputhook {
+namespace config {
+
+bool ForEachLine(const char *path, const LineCallback &callback) {
+    std::ifstream file{path};
+    if (!file.is_open())
+        return false;
+
+    std::string line;
+    std::vector<std::string_view> tokens;
+    for (int lineNo{1}; std::getline(file, line); lineNo++) {
+        std::string_view view{line};
+        view = view.substr(0, view.find('#'));
+
+        tokens.clear();
+        while (!view.empty()) {
+            auto start{view.find_first_not_of(" \t\r")};
+            if (start == std::string_view::npos)
+                break;
+
+            view.remove_prefix(start);
+            auto end{std::min(view.find_first_of(" \t\r"), view.size())};
+            tokens.push_back(view.substr(0, end));
+            view.remove_prefix(end);
+        }
+
+        if (!tokens.empty())
+            callback(tokens, lineNo);
+    }
+
+    return true;
+}
+
+bool ParseInt(std::string_view token, int32_t &out) {
+    std::string str{token};
+    // Only an explicit 0x prefix selects hex, a leading zero is still decimal rather than octal
+    auto digits{token.substr(!token.empty() && (token[0] == '-' || token[0] == '+'))};
+    int base{digits.size() > 1 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X') ? 16 : 10};
+    char *end{};
+    errno = 0;
+    long value{std::strtol(str.c_str(), &end, base)};
+    if (str.empty() || *end != '\0' || errno || value < INT32_MIN || value > INT32_MAX)
+        return false;
+
+    out = static_cast<int32_t>(value);
+    return true;
+}
+
+bool ParseFloat(std::string_view token, float &out) {
+    std::string str{token};
+    char *end{};
+    errno = 0;
+    float value{std::strtof(str.c_str(), &end)};
+    if (str.empty() || *end != '\0' || errno)
+        return false;
+
+    out = value;
+    return true;
+}
+
+} // namespace config
+} // namespace inputhook
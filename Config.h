@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_CONFIG_H
+#define INPUTHOOK_CONFIG_H
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+namespace inputhook {
+namespace config {
+
+constexpr std::string_view Dir{"/vendor/etc/inputhook"};
+
+//! Identifies a kind of device for config profiles
+inline uint32_t ProfileId(int32_t vid, int32_t pid) {
+    return (static_cast<uint32_t>(vid & 0xFFFF) << 16) | static_cast<uint32_t>(pid & 0xFFFF);
+}
+
+using LineCallback = std::function<void(const std::vector<std::string_view> &tokens, int lineNo)>;
+
+//! Calls |callback| with the whitespace separated tokens of every non-empty line in |path|, '#' starts a comment
+//! @return If the file could be read
+bool ForEachLine(const char *path, const LineCallback &callback);
+
+//! Parses a decimal or 0x prefixed hexadecimal integer, the whole token must be consumed
+bool ParseInt(std::string_view token, int32_t &out);
+
+bool ParseFloat(std::string_view token, float &out);
+
+} // namespace config
+} // namespace inputhook
+
+#endif // INPUTHOOK_CONFIG_H
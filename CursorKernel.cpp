@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "CursorKernel.h"
+#include "Metrics.h"
+
+// Both versions have to round every operation the same way for their results to match, so nothing may be fused into an FMA.
+// Android.bp builds this file with -ffp-contract=off as GCC ignores the pragma.
+#ifdef __clang__
+#pragma STDC FP_CONTRACT OFF
+#endif
+
+namespace inputhook {
+namespace cursor {
+
+// GCC/Clang vector extensions lower to NEON on arm64 and SSE on x86 without any target specific code
+typedef float FloatVec __attribute__((vector_size(Lanes * sizeof(float))));
+typedef int32_t IntVec __attribute__((vector_size(Lanes * sizeof(int32_t))));
+
+static_assert(MaxSources % Lanes == 0, "Sources must fill whole vectors");
+
+static FloatVec Load(const float *ptr) {
+    FloatVec value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+template<typename Vec>
+static void Store(void *ptr, Vec value) {
+    std::memcpy(ptr, &value, sizeof(value));
+}
+
+static FloatVec Splat(float value) {
+    return FloatVec{} + value;
+}
+
+//! @return |a| where |mask| is set and |b| elsewhere, |mask| lanes must be all ones or all zeroes
+static FloatVec Select(IntVec mask, FloatVec a, FloatVec b) {
+    return reinterpret_cast<FloatVec>((mask & reinterpret_cast<IntVec>(a)) | (~mask & reinterpret_cast<IntVec>(b)));
+}
+
+static FloatVec Abs(FloatVec value) {
+    return reinterpret_cast<FloatVec>(reinterpret_cast<IntVec>(value) & 0x7FFFFFFF);
+}
+
+//! Rounds half away from zero to an integer like std::round, valid for the range of int32_t
+static IntVec Round(FloatVec value) {
+    IntVec truncated{__builtin_convertvector(value, IntVec)};
+    FloatVec fraction{value - __builtin_convertvector(truncated, FloatVec)}; // Exact as both share the integral part
+    return truncated - (fraction >= 0.5f) + (fraction <= -0.5f); // Comparisons are -1 when true
+}
+
+//! Evaluated per lane with std::pow even for integral powers, as repeated multiplication can round differently
+static FloatVec Pow(FloatVec value, float power) {
+    for (size_t lane{}; lane < Lanes; lane++)
+        value[lane] = std::pow(value[lane], power);
+    return value;
+}
+
+void Update(Sources &sources, const Params &params) {
+    FloatVec deadzone{Splat(params.deadzone)}, limit{Splat(1.0f - params.deadzone)}, speed{Splat(params.speed)}, zero{};
+    for (size_t i{}; i < MaxSources; i += Lanes) {
+        FloatVec x{Load(sources.x + i)}, y{Load(sources.y + i)};
+
+        // Inputs inside the deadzone are clamped to its edge by the scalar version, which this is equivalent to
+        FloatVec adjustedX{Abs(x) - deadzone}, adjustedY{Abs(y) - deadzone};
+        adjustedX = Select(adjustedX > zero, adjustedX, zero);
+        adjustedY = Select(adjustedY > zero, adjustedY, zero);
+
+        FloatVec combined{adjustedX + adjustedY};
+        combined = Select(limit < combined, limit, combined);
+        FloatVec combinedPow{Pow(combined, params.power)};
+
+        FloatVec rsX{combinedPow * adjustedX * Select(x > zero, speed, -speed)};
+        FloatVec rsY{combinedPow * adjustedY * Select(y > zero, speed, -speed)};
+
+        // Sources that are inside the deadzone are left untouched entirely, including the sign of a zero accumulator
+        IntVec activeX{adjustedX != zero}, activeY{adjustedY != zero};
+        FloatVec accumulateX{Load(sources.accumulateX + i)}, accumulateY{Load(sources.accumulateY + i)};
+        FloatVec nextX{accumulateX + rsX}, nextY{accumulateY + rsY};
+        Store(sources.changeX + i, (Round(nextX) - Round(accumulateX)) & activeX);
+        Store(sources.changeY + i, (Round(nextY) - Round(accumulateY)) & activeY);
+        Store(sources.accumulateX + i, Select(activeX, nextX, accumulateX));
+        Store(sources.accumulateY + i, Select(activeY, nextY, accumulateY));
+    }
+}
+
+static float Deadzone(float value, float deadzone) {
+    if (value >= 0.0f && value < deadzone)
+        return deadzone;
+
+    if (value < 0.0f && value > -deadzone)
+        return -deadzone;
+
+    return value;
+}
+
+void UpdateReference(Sources &sources, const Params &params) {
+    for (size_t i{}; i < MaxSources; i++) {
+        float adjustedX{std::abs(Deadzone(sources.x[i], params.deadzone)) - params.deadzone};
+        float adjustedY{std::abs(Deadzone(sources.y[i], params.deadzone)) - params.deadzone};
+
+        float combined{std::min(adjustedX + adjustedY, 1.0f - params.deadzone)};
+        float combinedPow{std::pow(combined, params.power)};
+
+        sources.changeX[i] = sources.changeY[i] = 0;
+        if (adjustedX != 0.0f) {
+            float rsX = combinedPow * adjustedX * ((sources.x[i] > 0.0f) ? params.speed : -params.speed);
+
+            sources.changeX[i] = static_cast<int32_t>(std::round(sources.accumulateX[i] + rsX)) - static_cast<int32_t>(std::round(sources.accumulateX[i]));
+            sources.accumulateX[i] += rsX;
+        }
+
+        if (adjustedY != 0.0f) {
+            float rsY = combinedPow * adjustedY * ((sources.y[i] > 0.0f) ? params.speed : -params.speed);
+
+            sources.changeY[i] = static_cast<int32_t>(std::round(sources.accumulateY[i] + rsY)) - static_cast<int32_t>(std::round(sources.accumulateY[i]));
+            sources.accumulateY[i] += rsY;
+        }
+    }
+}
+
+bool Benchmark(int fd) {
+    constexpr size_t Frames{4096}; //!< Distinct sets of stick positions, cycled through so branches can't be learnt
+    constexpr size_t Iterations{64};
+
+    std::mt19937 random{0};
+    std::uniform_real_distribution<float> position{-1.0f, 1.0f};
+    std::vector<Sources> frames(Frames);
+    for (auto &frame : frames) {
+        frame = {};
+        for (size_t i{}; i < MaxSources; i++) {
+            // Leave some sources idle or inside the deadzone like a real mix of controllers would
+            float scale{i % 3 == 0 ? 0.05f : 1.0f};
+            frame.x[i] = position(random) * scale;
+            frame.y[i] = position(random) * scale;
+        }
+    }
+
+    bool matched{true};
+    for (float power : {3.0f, 2.5f}) {
+        Params params{.deadzone = 0.1f, .power = power, .speed = 27.0f};
+
+        Sources vector{}, reference{};
+        size_t mismatches{};
+        for (size_t frame{}; frame < Frames; frame++) {
+            std::memcpy(vector.x, frames[frame].x, sizeof(vector.x));
+            std::memcpy(vector.y, frames[frame].y, sizeof(vector.y));
+            std::memcpy(reference.x, frames[frame].x, sizeof(reference.x));
+            std::memcpy(reference.y, frames[frame].y, sizeof(reference.y));
+            Update(vector, params);
+            UpdateReference(reference, params);
+            if (std::memcmp(&vector, &reference, sizeof(Sources)) != 0)
+                mismatches++;
+        }
+
+        auto time{[&](void (*update)(Sources &, const Params &)) {
+            Sources state{};
+            auto start{metrics::NowNs()};
+            for (size_t iteration{}; iteration < Iterations; iteration++) {
+                for (auto &frame : frames) {
+                    std::memcpy(state.x, frame.x, sizeof(state.x));
+                    std::memcpy(state.y, frame.y, sizeof(state.y));
+                    update(state, params);
+                }
+            }
+            return static_cast<double>(metrics::NowNs() - start) / (Frames * Iterations);
+        }};
+
+        double referenceNs{time(UpdateReference)}, vectorNs{time(Update)};
+        dprintf(fd, "Cursor update of %zu sources (power %.1f): reference %.1f ns, vector %.1f ns (%.2fx), %zu/%zu frames mismatched%s\n",
+                MaxSources, power, referenceNs, vectorNs, referenceNs / vectorNs, mismatches, Frames, mismatches ? " FAIL" : "");
+        matched &= mismatches == 0;
+    }
+
+    return matched;
+}
+
+} // namespace cursor
+} // namespace inputhook
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_CURSOR_KERNEL_H
+#define INPUTHOOK_CURSOR_KERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace inputhook {
+namespace cursor {
+
+constexpr size_t Lanes{4}; //!< Sources processed per vector, a 128-bit vector maps to a single NEON or SSE register
+constexpr size_t MaxSources{8};
+
+//! The cursor state of every source in structure-of-arrays form so all of them are updated in one pass
+struct Sources {
+    alignas(16) float x[MaxSources]; //!< The stick position of each source in [-1, 1], unused sources are left at 0
+    alignas(16) float y[MaxSources];
+    alignas(16) float accumulateX[MaxSources]; //!< Sub-pixel cursor movement carried between ticks
+    alignas(16) float accumulateY[MaxSources];
+    alignas(16) int32_t changeX[MaxSources]; //!< The whole pixels to move by, written by the update
+    alignas(16) int32_t changeY[MaxSources];
+};
+
+struct Params {
+    float deadzone;
+    float power;
+    float speed;
+};
+
+//! Applies the deadzone and velocity curve to every source and accumulates the resulting movement
+void Update(Sources &sources, const Params &params);
+
+//! The scalar cursor curve as it was before Update, which must leave Sources bit-identical to it
+void UpdateReference(Sources &sources, const Params &params);
+
+/**
+ * @brief Compares Update against UpdateReference on random input and writes the time per update of both to the given fd
+ * @return If every frame matched exactly
+ */
+bool Benchmark(int fd);
+
+} // namespace cursor
+} // namespace inputhook
+
+#endif // INPUTHOOK_CURSOR_KERNEL_H
@@ -27,6 +27,11 @@ void DeviceDb::AddDevice(int32_t id, int32_t vid, int32_t pid) {
                 return DeviceDescriptor{
                     .blacklisted = true
                 };
+            case ID(0x054c, 0x09cc): // DualShock 4 (v2) and DualSense report several times per cursor tick
+            case ID(0x054c, 0x0ce6):
+                return DeviceDescriptor{
+                    .decimation = MotionDecimation::Peak
+                };
             default:
                 return DeviceDescriptor{};
         }
@@ -24,8 +24,25 @@
 
 namespace inputhook {
 
+//! How the motion samples a device reports between two cursor ticks are combined
+enum class MotionDecimation : uint8_t {
+    Latest, //!< Only the most recent sample is used
+    Peak, //!< The sample with the largest right stick deflection is used, so flicks on high-rate devices aren't lost
+    Mean, //!< The samples are averaged, this smooths out noisy sticks at the cost of up to half a tick of lag
+};
+
+//! The absolute axes a device reports its right stick on
+enum class RightStickAxes : uint8_t {
+    Detect, //!< Picked from the axes the device has, see RsMouse::FindRightStick
+    RxRy, //!< ABS_RX/ABS_RY, as used by xpad, hid-sony, hid-nintendo and most other gamepad drivers
+    ZRz, //!< ABS_Z/ABS_RZ, as used by pads that are handled by hid-generic
+    None, //!< No right stick, e.g. for a wheel that has its pedals on ABS_Z/ABS_RZ
+};
+
 struct DeviceDescriptor {
     bool blacklisted{}; //!< If this device shouldn't be used for any input hooks
+    MotionDecimation decimation{MotionDecimation::Latest};
+    RightStickAxes rightStick{RightStickAxes::Detect}; //!< Overrides the detected right stick axes
 };
 
 class DeviceDb {
@@ -38,6 +55,10 @@ class DeviceDb {
     void RemoveDevice(int32_t id);
 
     DeviceDescriptor at(int32_t id) const;
+
+    size_t size() const {
+        return deviceMap.size();
+    }
 };
 
 } // namespace inputhook
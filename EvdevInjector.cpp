@@ -17,334 +17,320 @@
 // Taken from frameworks/native/services/vr/virtual_touchpad
 
 #include "EvdevInjector.h"
+#include "EvdevInjectorImpl.h"
 
 #include <errno.h>
 #include <inttypes.h>
 #include <linux/input.h>
+#include <linux/io_uring.h>
 #include <log/log.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <iterator>
+
+#include "Metrics.h"
+#include "Trace.h"
+
 namespace inputhook {
 
-int EvdevInjector::UInput::Open() {
+int SyscallUInput::Open() {
   errno = 0;
-  fd_.reset(open("/dev/uinput", O_WRONLY | O_NONBLOCK));
+  fd_.reset(open("/dev/uinput", O_RDWR | O_NONBLOCK | O_CLOEXEC));
   if (fd_.get() < 0) {
     ALOGE("couldn't open uinput (r=%d errno=%d)", fd_.get(), errno);
   }
   return errno;
 }
 
-int EvdevInjector::UInput::Close() {
+int SyscallUInput::Close() {
   errno = 0;
   fd_.reset();
   return errno;
 }
 
-int EvdevInjector::UInput::Write(const void* buf, size_t count) {
-  ALOGV("UInput::Write(%zu, %02X...)", count, *static_cast<const char*>(buf));
+int SyscallUInput::Write(const void* buf, size_t count) {
   errno = 0;
   ssize_t r = write(fd_.get(), buf, count);
+  trace::Trace(trace::Point::UInputWrite, static_cast<int32_t>(count), errno);
   if (r != static_cast<ssize_t>(count)) {
     ALOGE("write(%zu) failed (r=%zd errno=%d)", count, r, errno);
   }
   return errno;
 }
 
-int EvdevInjector::UInput::IoctlSetInt(int request, int value) {
-  ALOGV("UInput::IoctlSetInt(0x%X, 0x%X)", request, value);
+int SyscallUInput::Read(void* buf, size_t count) {
+  errno = 0;
+  ssize_t r = read(fd_.get(), buf, count);
+  if (r != static_cast<ssize_t>(count) && errno == 0) {
+    errno = EIO;
+  }
+  return errno;
+}
+
+int SyscallUInput::IoctlSetInt(int request, int value) {
   errno = 0;
-  if (const int status = ioctl(fd_.get(), request, value)) {
+  const int status = ioctl(fd_.get(), request, value);
+  trace::Trace(trace::Point::UInputIoctl, request, value, errno);
+  if (status) {
     ALOGE("ioctl(%d, 0x%X, 0x%X) failed (r=%d errno=%d)", fd_.get(), request,
           value, status, errno);
   }
   return errno;
 }
 
-int EvdevInjector::UInput::IoctlVoid(int request) {
-  ALOGV("UInput::IoctlVoid(0x%X)", request);
+int SyscallUInput::IoctlVoid(int request) {
   errno = 0;
-  if (const int status = ioctl(fd_.get(), request)) {
+  const int status = ioctl(fd_.get(), request);
+  trace::Trace(trace::Point::UInputIoctl, request, 0, errno);
+  if (status) {
     ALOGE("ioctl(%d, 0x%X) failed (r=%d errno=%d)", fd_.get(), request, status,
           errno);
   }
   return errno;
 }
 
-void EvdevInjector::Close() {
-  uinput_->Close();
-  state_ = State::CLOSED;
-}
-
-int EvdevInjector::ConfigureBegin(const char* device_name, int16_t bustype,
-                                  int16_t vendor, int16_t product,
-                                  int16_t version) {
-  ALOGV("ConfigureBegin %s 0x%04" PRIX16 " 0x%04" PRIX16 " 0x%04" PRIX16
-        " 0x%04" PRIX16 "",
-        device_name, bustype, vendor, product, version);
-  if (!device_name || strlen(device_name) >= UINPUT_MAX_NAME_SIZE) {
-    return Error(ERROR_DEVICE_NAME);
-  }
-  if (const int status = RequireState(State::NEW)) {
-    return status;
-  }
-  if (!uinput_) {
-    owned_uinput_.reset(new EvdevInjector::UInput());
-    uinput_ = owned_uinput_.get();
-  }
-  if (const int status = uinput_->Open()) {
-    // Without uinput we're dead in the water.
-    state_ = State::CLOSED;
-    return Error(status);
+int SyscallUInput::IoctlPtr(int request, void* arg) {
+  errno = 0;
+  const int status = ioctl(fd_.get(), request, arg);
+  trace::Trace(trace::Point::UInputIoctl, request, 0, errno);
+  if (status) {
+    ALOGE("ioctl(%d, 0x%X, %p) failed (r=%d errno=%d)", fd_.get(), request,
+          arg, status, errno);
   }
-  state_ = State::CONFIGURING;
-  // Initialize device setting structure.
-  memset(&uidev_, 0, sizeof(uidev_));
-  strncpy(uidev_.name, device_name, UINPUT_MAX_NAME_SIZE);
-  uidev_.id.bustype = bustype;
-  uidev_.id.vendor = vendor;
-  uidev_.id.product = product;
-  uidev_.id.version = version;
-  return 0;
+  return errno;
 }
 
-int EvdevInjector::ConfigureInputProperty(int property) {
-  ALOGV("ConfigureInputProperty %d", property);
-  if (property < 0 || property >= INPUT_PROP_CNT) {
-    ALOGE("property 0x%X out of range [0,0x%X)", property, INPUT_PROP_CNT);
-    return Error(ERROR_PROPERTY_RANGE);
-  }
-  if (const int status = RequireState(State::CONFIGURING)) {
-    return status;
-  }
-  if (const int status = uinput_->IoctlSetInt(UI_SET_PROPBIT, property)) {
-    ALOGE("failed to set property %d", property);
-    return Error(status);
-  }
-  return 0;
-}
+struct IoUringUInput::Ring {
+  struct Slot {
+    input_event events[kSlotEvents];
+    struct iovec iov;
+    bool in_flight;
+  };
 
-int EvdevInjector::ConfigureKey(uint16_t key) {
-  ALOGV("ConfigureKey 0x%02" PRIX16 "", key);
-  if (key < 0 || key >= KEY_CNT) {
-    ALOGE("key 0x%X out of range [0,0x%X)", key, KEY_CNT);
-    return Error(ERROR_KEY_RANGE);
-  }
-  if (const int status = RequireState(State::CONFIGURING)) {
-    return status;
-  }
-  if (const int status = EnableEventType(EV_KEY)) {
-    return status;
-  }
-  if (const int status = uinput_->IoctlSetInt(UI_SET_KEYBIT, key)) {
-    ALOGE("failed to enable EV_KEY 0x%02" PRIX16 "", key);
-    return Error(status);
-  }
-  return 0;
-}
+  android::base::unique_fd fd;
+  void* sq_map = MAP_FAILED;
+  size_t sq_map_size = 0;
+  void* cq_map = MAP_FAILED;
+  size_t cq_map_size = 0;
+  void* sqe_map = MAP_FAILED;
+  size_t sqe_map_size = 0;
 
-int EvdevInjector::ConfigureAbs(uint16_t abs_type, int32_t min, int32_t max,
-                                int32_t fuzz, int32_t flat) {
-  ALOGV("ConfigureAbs 0x%" PRIX16 " %" PRId32 " %" PRId32 " %" PRId32
-        " %" PRId32 "",
-        abs_type, min, max, fuzz, flat);
-  if (abs_type < 0 || abs_type >= ABS_CNT) {
-    ALOGE("EV_ABS type 0x%" PRIX16 " out of range [0,0x%X)", abs_type, ABS_CNT);
-    return Error(ERROR_ABS_RANGE);
-  }
-  if (const int status = RequireState(State::CONFIGURING)) {
-    return status;
-  }
-  if (const int status = EnableEventType(EV_ABS)) {
-    return status;
-  }
-  if (const int status = uinput_->IoctlSetInt(UI_SET_ABSBIT, abs_type)) {
-    ALOGE("failed to enable EV_ABS 0x%" PRIX16 "", abs_type);
-    return Error(status);
-  }
-  uidev_.absmin[abs_type] = min;
-  uidev_.absmax[abs_type] = max;
-  uidev_.absfuzz[abs_type] = fuzz;
-  uidev_.absflat[abs_type] = flat;
-  return 0;
-}
+  unsigned* sq_tail = nullptr;
+  unsigned sq_mask = 0;
+  unsigned* sq_array = nullptr;
+  io_uring_sqe* sqes = nullptr;
+  unsigned* cq_head = nullptr;
+  unsigned* cq_tail = nullptr;
+  unsigned cq_mask = 0;
+  io_uring_cqe* cqes = nullptr;
 
-int EvdevInjector::ConfigureMultiTouchXY(int x0, int y0, int x1, int y1) {
-  if (const int status = ConfigureAbs(ABS_MT_POSITION_X, x0, x1, 0, 0)) {
-    return status;
-  }
-  if (const int status = ConfigureAbs(ABS_MT_POSITION_Y, y0, y1, 0, 0)) {
-    return status;
-  }
-  return 0;
-}
-
-int EvdevInjector::ConfigureAbsSlots(int slots) {
-  return ConfigureAbs(ABS_MT_SLOT, 0, slots, 0, 0);
-}
+  Slot slots[kSlots] = {};
+  size_t next_slot = 0;
 
-int EvdevInjector::ConfigureRel(uint16_t rel_type) {
-  ALOGV("ConfigureRel 0x%" PRIX16 "", rel_type);
-  if (rel_type < 0 || rel_type >= REL_CNT) {
-    ALOGE("EV_REL type 0x%" PRIX16 " out of range [0,0x%X)", rel_type, REL_CNT);
-    return Error(ERROR_REL_RANGE);
-  }
-  if (const int status = RequireState(State::CONFIGURING)) {
-    return status;
-  }
-  if (const int status = EnableEventType(EV_REL)) {
-    return status;
-  }
-  if (const int status = uinput_->IoctlSetInt(UI_SET_RELBIT, rel_type)) {
-    ALOGE("failed to enable EV_REL 0x%" PRIX16 "", rel_type);
-    return Error(status);
+  ~Ring() {
+    if (sqe_map != MAP_FAILED) {
+      munmap(sqe_map, sqe_map_size);
+    }
+    if (cq_map != MAP_FAILED && cq_map != sq_map) {
+      munmap(cq_map, cq_map_size);
+    }
+    if (sq_map != MAP_FAILED) {
+      munmap(sq_map, sq_map_size);
+    }
   }
-  return 0;
-}
 
-int EvdevInjector::ConfigureEnd() {
-  ALOGV("ConfigureEnd:");
-  ALOGV("  name=\"%s\"", uidev_.name);
-  ALOGV("  id.bustype=0x%04" PRIX16, uidev_.id.bustype);
-  ALOGV("  id.vendor=0x%04" PRIX16, uidev_.id.vendor);
-  ALOGV("  id.product=0x%04" PRIX16, uidev_.id.product);
-  ALOGV("  id.version=0x%04" PRIX16, uidev_.id.version);
-  ALOGV("  ff_effects_max=%" PRIu32, uidev_.ff_effects_max);
-  for (int i = 0; i < ABS_CNT; ++i) {
-    if (uidev_.absmin[i]) {
-      ALOGV("  absmin[%d]=%" PRId32, i, uidev_.absmin[i]);
+  // Returns an errno code if the kernel or policy doesn't allow io_uring.
+  int SetUp() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd.reset(static_cast<int>(syscall(__NR_io_uring_setup, kSlots, &params)));
+    if (fd.get() < 0) {
+      return errno;
     }
-    if (uidev_.absmax[i]) {
-      ALOGV("  absmax[%d]=%" PRId32, i, uidev_.absmax[i]);
+
+    sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_map = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_map) {
+      sq_map_size = cq_map_size = std::max(sq_map_size, cq_map_size);
     }
-    if (uidev_.absfuzz[i]) {
-      ALOGV("  absfuzz[%d]=%" PRId32, i, uidev_.absfuzz[i]);
+    sq_map = mmap(nullptr, sq_map_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd.get(), IORING_OFF_SQ_RING);
+    if (sq_map == MAP_FAILED) {
+      return errno;
     }
-    if (uidev_.absflat[i]) {
-      ALOGV("  absflat[%d]=%" PRId32, i, uidev_.absflat[i]);
+    cq_map = single_map ? sq_map
+                        : mmap(nullptr, cq_map_size, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, fd.get(),
+                               IORING_OFF_CQ_RING);
+    if (cq_map == MAP_FAILED) {
+      return errno;
+    }
+    sqe_map_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqe_map = mmap(nullptr, sqe_map_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd.get(), IORING_OFF_SQES);
+    if (sqe_map == MAP_FAILED) {
+      return errno;
     }
-  }
 
-  if (const int status = RequireState(State::CONFIGURING)) {
-    return status;
-  }
-  // Write out device settings.
-  if (const int status = uinput_->Write(&uidev_, sizeof uidev_)) {
-    ALOGE("failed to write device settings");
-    return Error(status);
-  }
-  // Create device node.
-  if (const int status = uinput_->IoctlVoid(UI_DEV_CREATE)) {
-    ALOGE("failed to create device node");
-    return Error(status);
+    char* sq = static_cast<char*>(sq_map);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqes = static_cast<io_uring_sqe*>(sqe_map);
+    char* cq = static_cast<char*>(cq_map);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return 0;
   }
-  state_ = State::READY;
-  return 0;
-}
+};
+
+IoUringUInput::IoUringUInput() {}
+
+IoUringUInput::~IoUringUInput() { Close(); }
 
-int EvdevInjector::Send(uint16_t type, uint16_t code, int32_t value) {
-  ALOGV("Send(0x%" PRIX16 ", 0x%" PRIX16 ", 0x%" PRIX32 ")", type, code, value);
-  if (const int status = RequireState(State::READY)) {
+int IoUringUInput::Open() {
+  if (const int status = SyscallUInput::Open()) {
     return status;
   }
-  struct input_event event;
-  memset(&event, 0, sizeof(event));
-  event.type = type;
-  event.code = code;
-  event.value = value;
-  if (const int status = uinput_->Write(&event, sizeof(event))) {
-    ALOGE("failed to write event 0x%" PRIX16 ", 0x%" PRIX16 ", 0x%" PRIX32,
-          type, code, value);
-    return Error(status);
+  auto ring = std::make_unique<Ring>();
+  if (const int status = ring->SetUp()) {
+    ALOGW("io_uring unavailable (errno=%d), falling back to write()", status);
+    return 0;
   }
+  ring_ = std::move(ring);
   return 0;
 }
 
-int EvdevInjector::SendSynReport() { return Send(EV_SYN, SYN_REPORT, 0); }
-
-int EvdevInjector::SendKey(uint16_t code, int32_t value) {
-  return Send(EV_KEY, code, value);
-}
-
-int EvdevInjector::SendAbs(uint16_t code, int32_t value) {
-  return Send(EV_ABS, code, value);
-}
-
-int EvdevInjector::SendRel(uint16_t code, int32_t value) {
-  return Send(EV_REL, code, value);
+int IoUringUInput::Close() {
+  if (ring_) {
+    Drain();
+  }
+  return SyscallUInput::Close();
 }
 
-int EvdevInjector::SendMultiTouchSlot(int32_t slot) {
-  if (latest_slot_ != slot) {
-    if (const int status = SendAbs(ABS_MT_SLOT, slot)) {
+int IoUringUInput::WriteEvents(const input_event* events, size_t count) {
+  if (!ring_ || count > kSlotEvents) {
+    return SyscallUInput::WriteEvents(events, count);
+  }
+  Reap(false);
+  Ring::Slot& slot = ring_->slots[ring_->next_slot];
+  while (slot.in_flight) {
+    if (const int status = Reap(true)) {
       return status;
     }
-    latest_slot_ = slot;
   }
-  return 0;
-}
+  memcpy(slot.events, events, count * sizeof(*events));
+  slot.iov.iov_base = slot.events;
+  slot.iov.iov_len = count * sizeof(*events);
 
-int EvdevInjector::SendMultiTouchXY(int32_t slot, int32_t id, int32_t x,
-                                    int32_t y) {
-  if (const int status = SendMultiTouchSlot(slot)) {
-    return status;
-  }
-  if (const int status = SendAbs(ABS_MT_TRACKING_ID, id)) {
-    return status;
-  }
-  if (const int status = SendAbs(ABS_MT_POSITION_X, x)) {
-    return status;
-  }
-  if (const int status = SendAbs(ABS_MT_POSITION_Y, y)) {
-    return status;
+  const unsigned tail = *ring_->sq_tail;
+  const unsigned index = tail & ring_->sq_mask;
+  io_uring_sqe* sqe = &ring_->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_WRITEV;
+  sqe->fd = GetFd();
+  sqe->addr = reinterpret_cast<uintptr_t>(&slot.iov);
+  sqe->len = 1;
+  // uinput writes are punted to worker threads, which could otherwise let a
+  // batch overtake the one before it.
+  sqe->flags = IOSQE_IO_DRAIN;
+  sqe->user_data = ring_->next_slot;
+  ring_->sq_array[index] = index;
+  __atomic_store_n(ring_->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  errno = 0;
+  const long r =
+      syscall(__NR_io_uring_enter, ring_->fd.get(), 1, 0, 0, nullptr, 0);
+  trace::Trace(trace::Point::UInputWrite, static_cast<int32_t>(count), errno);
+  if (r != 1) {
+    // The entry is stuck in the ring, so give up on it and write directly.
+    ALOGE("io_uring_enter failed (r=%ld errno=%d), falling back to write()", r,
+          errno);
+    Drain();
+    return SyscallUInput::WriteEvents(events, count);
   }
+  slot.in_flight = true;
+  ring_->next_slot = (ring_->next_slot + 1) % kSlots;
   return 0;
 }
 
-int EvdevInjector::SendMultiTouchLift(int32_t slot) {
-  if (const int status = SendMultiTouchSlot(slot)) {
-    return status;
+void IoUringUInput::Drain() {
+  // The kernel may still be reading queued events from the slots.
+  for (const Ring::Slot& slot : ring_->slots) {
+    while (slot.in_flight && Reap(true) == 0) {
+    }
   }
-  if (const int status = SendAbs(ABS_MT_TRACKING_ID, -1)) {
-    return status;
+  ring_.reset();
+}
+
+int IoUringUInput::Reap(bool wait) {
+  if (wait && syscall(__NR_io_uring_enter, ring_->fd.get(), 0, 1,
+                      IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+      errno != EINTR) {
+    ALOGE("io_uring_enter failed waiting for writes (errno=%d)", errno);
+    return errno;
+  }
+  unsigned head = *ring_->cq_head;
+  const unsigned tail = __atomic_load_n(ring_->cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head) {
+    const io_uring_cqe& cqe = ring_->cqes[head & ring_->cq_mask];
+    Ring::Slot& slot = ring_->slots[cqe.user_data % kSlots];
+    if (cqe.res != static_cast<int32_t>(slot.iov.iov_len)) {
+      metrics::registry.injectorWriteErrors.Add();
+      ALOGE("queued write(%zu) failed (r=%d)", slot.iov.iov_len, cqe.res);
+    }
+    slot.in_flight = false;
   }
+  __atomic_store_n(ring_->cq_head, head, __ATOMIC_RELEASE);
   return 0;
 }
 
-int EvdevInjector::Error(int code) {
-  if (!error_) {
-    error_ = code;
+int LoopbackUInput::Open() {
+  int fds[2];
+  if (pipe2(fds, O_NONBLOCK | O_CLOEXEC)) {
+    return errno;
   }
-  return code;
+  read_fd_.reset(fds[0]);
+  write_fd_.reset(fds[1]);
+  return 0;
 }
 
-int EvdevInjector::RequireState(State required_state) {
-  if (error_) {
-    return error_;
-  }
-  if (state_ != required_state) {
-    ALOGE("in state %d but require state %d", static_cast<int>(state_),
-          static_cast<int>(required_state));
-    return Error(ERROR_SEQUENCING);
-  }
+int LoopbackUInput::Close() {
+  write_fd_.reset();
+  read_fd_.reset();
   return 0;
 }
 
-int EvdevInjector::EnableEventType(uint16_t type) {
-  if (const int status = RequireState(State::CONFIGURING)) {
-    return status;
-  }
-  if (enabled_event_types_.count(type) > 0) {
-    return 0;
-  }
-  if (const int status = uinput_->IoctlSetInt(UI_SET_EVBIT, type)) {
-    ALOGE("failed to enable event type 0x%X", type);
-    return Error(status);
-  }
-  enabled_event_types_.insert(type);
+int LoopbackUInput::WriteEvents(const input_event* events, size_t count) {
+  // Stamp the events like the kernel would.
+  input_event stamped[BasicEvdevInjector<LoopbackUInput>::kMaxPendingEvents];
+  count = std::min(count, std::size(stamped));
+  const uint64_t now = metrics::NowNs();
+  for (size_t i = 0; i < count; ++i) {
+    stamped[i] = events[i];
+    stamped[i].input_event_sec =
+        static_cast<decltype(stamped[i].input_event_sec)>(now / 1000000000ULL);
+    stamped[i].input_event_usec =
+        static_cast<decltype(stamped[i].input_event_usec)>(
+            (now % 1000000000ULL) / 1000);
+  }
+  // A full pipe means nobody is reading, which is no reason to fail.
+  write(write_fd_.get(), stamped, count * sizeof(*stamped));
   return 0;
 }
 
+template class BasicEvdevInjector<SyscallUInput>;
+template class BasicEvdevInjector<IoUringUInput>;
+template class BasicEvdevInjector<LoopbackUInput>;
+
 }  // namespace inputhook
@@ -22,15 +22,128 @@
 #include <android-base/unique_fd.h>
 #include <linux/uinput.h>
 
+#include <array>
+#include <cerrno>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <unordered_set>
 
 namespace inputhook {
 
+// uinput I/O backends. EvdevInjector takes one of these as a compile-time
+// policy, so the calls on the send path are direct and can be inlined rather
+// than going through a vtable. Every backend provides:
+//
+//   int Open();
+//   int Close();
+//   int Write(const void* buf, size_t count);  // Device settings.
+//   int WriteEvents(const input_event* events, size_t count);
+//   int Read(void* buf, size_t count);
+//   int IoctlVoid(int request);
+//   int IoctlSetInt(int request, int value);
+//   int IoctlPtr(int request, void* arg);
+//   int GetFd() const;
+//   static constexpr int kFds;  // Descriptors held per device.
+//
+// Non-zero return values are |errno| codes.
+
+// System calls straight on /dev/uinput, one write() per batch of events.
+//
+class SyscallUInput {
+ public:
+  static constexpr int kFds = 1;
+
+  int Open();
+  int Close();
+  int Write(const void* buf, size_t count);
+  int WriteEvents(const input_event* events, size_t count) {
+    return Write(events, count * sizeof(*events));
+  }
+  int Read(void* buf, size_t count);
+  int IoctlVoid(int request);
+  int IoctlSetInt(int request, int value);
+  int IoctlPtr(int request, void* arg);
+  int GetFd() const { return fd_.get(); }
+
+ private:
+  android::base::unique_fd fd_;
+};
+
+// Queues batches of events on an io_uring, so the sending thread returns once
+// they're submitted rather than once the kernel has processed them. Falls back
+// to SyscallUInput's write() where the kernel lacks io_uring or policy denies
+// it. Errors of queued writes are only counted and logged, they can't be
+// returned to the sender.
+//
+class IoUringUInput : public SyscallUInput {
+ public:
+  static constexpr int kFds = 2;
+  static constexpr size_t kSlots = 8;        // Batches in flight.
+  static constexpr size_t kSlotEvents = 64;  // Events per batch.
+
+  IoUringUInput();
+  ~IoUringUInput();
+  int Open();
+  int Close();
+  int WriteEvents(const input_event* events, size_t count);
+
+  // Whether writes go through the ring rather than the write() fallback.
+  bool UsingRing() const { return ring_ != nullptr; }
+
+ private:
+  struct Ring;
+
+  // Consumes completed writes, waiting for at least one if |wait| is set.
+  int Reap(bool wait);
+
+  // Waits for all queued writes and releases the ring.
+  void Drain();
+
+  std::unique_ptr<Ring> ring_;
+};
+
+// Stand-in for /dev/uinput that feeds written events into a pipe, whose read
+// end takes the place of the evdev node. This is used where uinput or the
+// evdev node aren't accessible, it only covers our side of the path.
+//
+class LoopbackUInput {
+ public:
+  static constexpr int kFds = 2;
+
+  int Open();
+  int Close();
+  int Write(const void* buf, size_t count) { return 0; }
+  int WriteEvents(const input_event* events, size_t count);
+  int Read(void* buf, size_t count) { return EAGAIN; }
+  int IoctlVoid(int request) { return 0; }
+  int IoctlSetInt(int request, int value) { return 0; }
+  int IoctlPtr(int request, void* arg) { return 0; }
+  // Never readable, so feedback handling stays idle.
+  int GetFd() const { return write_fd_.get(); }
+  int GetReadFd() const { return read_fd_.get(); }
+
+ private:
+  android::base::unique_fd read_fd_;
+  android::base::unique_fd write_fd_;
+};
+
+// The backend of EvdevInjector, chosen with the uinput_backend Soong config
+// variable. Loopback wins so inputhook_harness uses it whatever the variable
+// is set to.
+#if defined(INPUTHOOK_UINPUT_LOOPBACK)
+using DefaultUInput = LoopbackUInput;
+#elif defined(INPUTHOOK_UINPUT_IO_URING)
+using DefaultUInput = IoUringUInput;
+#else
+using DefaultUInput = SyscallUInput;
+#endif
+
 // Simulated evdev input device.
 //
-class EvdevInjector {
+template <typename Backend>
+class BasicEvdevInjector {
  public:
   // EvdevInjector-specific error codes are negative integers; other non-zero
   // values returned from public routines are |errno| codes from underlying I/O.
@@ -47,30 +160,20 @@ class EvdevInjector {
     ERROR_ABS_RANGE = -4,       // |ABS_*| code out of range.
     ERROR_SEQUENCING = -5,      // Configure/Send out of order.
     ERROR_REL_RANGE = -6,       // |REL_*| code out of range.
+    ERROR_FF_RANGE = -7,        // |FF_*| code out of range.
+    ERROR_MSC_RANGE = -8,       // |MSC_*| code out of range.
   };
 
   // Key event |value| is not defined in <linux/input.h>.
   enum : int32_t { KEY_RELEASE = 0, KEY_PRESS = 1, KEY_REPEAT = 2 };
 
-  // UInput provides a shim to intercept /dev/uinput operations
-  // just above the system call level, for testing.
-  //
-  class UInput {
-   public:
-    UInput() {}
-    virtual ~UInput() {}
-    virtual int Open();
-    virtual int Close();
-    virtual int Write(const void* buf, size_t count);
-    virtual int IoctlVoid(int request);
-    virtual int IoctlSetInt(int request, int value);
-
-   private:
-    android::base::unique_fd fd_;
-  };
+  // Events queued before they're written out together.
+  static constexpr size_t kMaxPendingEvents = 64;
 
-  EvdevInjector() {}
-  ~EvdevInjector() { Close(); }
+  using UInput = Backend;
+
+  BasicEvdevInjector() {}
+  ~BasicEvdevInjector() { Close(); }
   void Close();
 
   int GetError() const { return error_; }
@@ -108,23 +211,55 @@ class EvdevInjector {
   // @param rel_type One of the |REL_*| constants from <linux/input.h>.
   int ConfigureRel(uint16_t rel_type);
 
+  // Configure a miscellaneous event.
+  // @param msc_type One of the |MSC_*| constants from <linux/input.h>.
+  int ConfigureMisc(uint16_t msc_type);
+
+  // Configure a force feedback effect type.
+  // @param ff_type One of the |FF_*| constants from <linux/input.h>.
+  // @param effects_max The number of effects that can be uploaded at once.
+  int ConfigureForceFeedback(uint16_t ff_type, uint32_t effects_max);
+
   // Complete configuration and create the input device.
   int ConfigureEnd();
 
-  // Send various events.
+  // The uinput fd, which becomes readable when the kernel sends force feedback
+  // or LED requests back to the device. Only valid once configured.
+  int GetFd() const { return uinput_.GetFd(); }
+
+  // Called with every EV_FF and EV_LED event sent to the device.
+  using FeedbackCallback = std::function<void(const input_event&)>;
+  void SetFeedbackCallback(FeedbackCallback callback) {
+    feedback_callback_ = std::move(callback);
+  }
+
+  // Services all pending requests from the kernel; force feedback uploads and
+  // erasures are acknowledged so that the requesting client doesn't block.
+  // Returns the number of events handled.
+  int HandleFeedback();
+
+  // Send various events. Events are queued and written out with the
+  // SYN_REPORT that completes their frame, so every frame must end in one.
+  // Sending is safe from several threads, though their frames may interleave.
   //
   int Send(uint16_t type, uint16_t code, int32_t value);
   int SendSynReport();
   int SendKey(uint16_t code, int32_t value);
   int SendAbs(uint16_t code, int32_t value);
   int SendRel(uint16_t code, int32_t value);
+  int SendMisc(uint16_t code, int32_t value);
   int SendMultiTouchSlot(int32_t slot);
   int SendMultiTouchXY(int32_t slot, int32_t id, int32_t x, int32_t y);
   int SendMultiTouchLift(int32_t slot);
 
+  // Holds back frames until the matching |EndBatch()|, which writes them out
+  // together. Batches nest.
+  void BeginBatch();
+  int EndBatch();
+
+  Backend& GetUInput() { return uinput_; }
+
  protected:
-  // Must be called only between construction and ConfigureBegin().
-  inline void SetUInputForTesting(UInput* uinput) { uinput_ = uinput; }
   // Caller must not retain pointer longer than EvdevInjector.
   inline const uinput_user_dev* GetUiDevForTesting() const { return &uidev_; }
 
@@ -142,20 +277,35 @@ class EvdevInjector {
   // @param type One of the |EV_*| constants from <linux/input.h>.
   int EnableEventType(uint16_t type);
 
-  // Active pointer to owned or testing UInput.
-  UInput* uinput_ = nullptr;
-  std::unique_ptr<UInput> owned_uinput_;
+  // Writes out the queued events; |pending_mutex_| must be held.
+  int Flush();
+
+  Backend uinput_;
 
   State state_ = State::NEW;
   int error_ = 0;
   uinput_user_dev uidev_;
   std::unordered_set<uint16_t> enabled_event_types_;
   int32_t latest_slot_ = -1;
+  FeedbackCallback feedback_callback_;
+
+  std::mutex pending_mutex_;
+  std::array<input_event, kMaxPendingEvents> pending_;
+  size_t pending_count_ = 0;
+  int batch_depth_ = 0;
 
-  EvdevInjector(const EvdevInjector&) = delete;
-  void operator=(const EvdevInjector&) = delete;
+  BasicEvdevInjector(const BasicEvdevInjector&) = delete;
+  void operator=(const BasicEvdevInjector&) = delete;
 };
 
+// All backends are instantiated in EvdevInjector.cpp so inputhook_harness can
+// benchmark them against each other.
+extern template class BasicEvdevInjector<SyscallUInput>;
+extern template class BasicEvdevInjector<IoUringUInput>;
+extern template class BasicEvdevInjector<LoopbackUInput>;
+
+using EvdevInjector = BasicEvdevInjector<DefaultUInput>;
+
 }  // namespace inputhook
 
 #endif  // INPUTHOOK_EVDEV_INJECTOR_H
@@ -0,0 +1,454 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Taken from frameworks/native/services/vr/virtual_touchpad
+
+// Definitions of BasicEvdevInjector's members. EvdevInjector.cpp includes this
+// to instantiate the real backends, and tests include it to instantiate a mock
+// one.
+
+#ifndef INPUTHOOK_EVDEV_INJECTOR_IMPL_H
+#define INPUTHOOK_EVDEV_INJECTOR_IMPL_H
+
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/input.h>
+#include <log/log.h>
+#include <string.h>
+
+#include "EvdevInjector.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+namespace inputhook {
+
+template <typename Backend>
+void BasicEvdevInjector<Backend>::Close() {
+  uinput_.Close();
+  state_ = State::CLOSED;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::ConfigureBegin(const char* device_name,
+                                               int16_t bustype, int16_t vendor,
+                                               int16_t product,
+                                               int16_t version) {
+  ALOGV("ConfigureBegin %s 0x%04" PRIX16 " 0x%04" PRIX16 " 0x%04" PRIX16
+        " 0x%04" PRIX16 "",
+        device_name, bustype, vendor, product, version);
+  if (!device_name || strlen(device_name) >= UINPUT_MAX_NAME_SIZE) {
+    return Error(ERROR_DEVICE_NAME);
+  }
+  if (const int status = RequireState(State::NEW)) {
+    return status;
+  }
+  if (const int status = uinput_.Open()) {
+    // Without uinput we're dead in the water.
+    state_ = State::CLOSED;
+    return Error(status);
+  }
+  state_ = State::CONFIGURING;
+  // Initialize device setting structure.
+  memset(&uidev_, 0, sizeof(uidev_));
+  strncpy(uidev_.name, device_name, UINPUT_MAX_NAME_SIZE);
+  uidev_.id.bustype = bustype;
+  uidev_.id.vendor = vendor;
+  uidev_.id.product = product;
+  uidev_.id.version = version;
+  return 0;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::ConfigureInputProperty(int property) {
+  ALOGV("ConfigureInputProperty %d", property);
+  if (property < 0 || property >= INPUT_PROP_CNT) {
+    ALOGE("property 0x%X out of range [0,0x%X)", property, INPUT_PROP_CNT);
+    return Error(ERROR_PROPERTY_RANGE);
+  }
+  if (const int status = RequireState(State::CONFIGURING)) {
+    return status;
+  }
+  if (const int status = uinput_.IoctlSetInt(UI_SET_PROPBIT, property)) {
+    ALOGE("failed to set property %d", property);
+    return Error(status);
+  }
+  return 0;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::ConfigureKey(uint16_t key) {
+  ALOGV("ConfigureKey 0x%02" PRIX16 "", key);
+  if (key < 0 || key >= KEY_CNT) {
+    ALOGE("key 0x%X out of range [0,0x%X)", key, KEY_CNT);
+    return Error(ERROR_KEY_RANGE);
+  }
+  if (const int status = RequireState(State::CONFIGURING)) {
+    return status;
+  }
+  if (const int status = EnableEventType(EV_KEY)) {
+    return status;
+  }
+  if (const int status = uinput_.IoctlSetInt(UI_SET_KEYBIT, key)) {
+    ALOGE("failed to enable EV_KEY 0x%02" PRIX16 "", key);
+    return Error(status);
+  }
+  return 0;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::ConfigureAbs(uint16_t abs_type, int32_t min,
+                                             int32_t max, int32_t fuzz,
+                                             int32_t flat) {
+  ALOGV("ConfigureAbs 0x%" PRIX16 " %" PRId32 " %" PRId32 " %" PRId32
+        " %" PRId32 "",
+        abs_type, min, max, fuzz, flat);
+  if (abs_type < 0 || abs_type >= ABS_CNT) {
+    ALOGE("EV_ABS type 0x%" PRIX16 " out of range [0,0x%X)", abs_type, ABS_CNT);
+    return Error(ERROR_ABS_RANGE);
+  }
+  if (const int status = RequireState(State::CONFIGURING)) {
+    return status;
+  }
+  if (const int status = EnableEventType(EV_ABS)) {
+    return status;
+  }
+  if (const int status = uinput_.IoctlSetInt(UI_SET_ABSBIT, abs_type)) {
+    ALOGE("failed to enable EV_ABS 0x%" PRIX16 "", abs_type);
+    return Error(status);
+  }
+  uidev_.absmin[abs_type] = min;
+  uidev_.absmax[abs_type] = max;
+  uidev_.absfuzz[abs_type] = fuzz;
+  uidev_.absflat[abs_type] = flat;
+  return 0;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::ConfigureMultiTouchXY(int x0, int y0, int x1,
+                                                      int y1) {
+  if (const int status = ConfigureAbs(ABS_MT_POSITION_X, x0, x1, 0, 0)) {
+    return status;
+  }
+  if (const int status = ConfigureAbs(ABS_MT_POSITION_Y, y0, y1, 0, 0)) {
+    return status;
+  }
+  return 0;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::ConfigureAbsSlots(int slots) {
+  return ConfigureAbs(ABS_MT_SLOT, 0, slots, 0, 0);
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::ConfigureRel(uint16_t rel_type) {
+  ALOGV("ConfigureRel 0x%" PRIX16 "", rel_type);
+  if (rel_type < 0 || rel_type >= REL_CNT) {
+    ALOGE("EV_REL type 0x%" PRIX16 " out of range [0,0x%X)", rel_type, REL_CNT);
+    return Error(ERROR_REL_RANGE);
+  }
+  if (const int status = RequireState(State::CONFIGURING)) {
+    return status;
+  }
+  if (const int status = EnableEventType(EV_REL)) {
+    return status;
+  }
+  if (const int status = uinput_.IoctlSetInt(UI_SET_RELBIT, rel_type)) {
+    ALOGE("failed to enable EV_REL 0x%" PRIX16 "", rel_type);
+    return Error(status);
+  }
+  return 0;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::ConfigureMisc(uint16_t msc_type) {
+  ALOGV("ConfigureMisc 0x%" PRIX16 "", msc_type);
+  if (msc_type >= MSC_CNT) {
+    ALOGE("EV_MSC type 0x%" PRIX16 " out of range [0,0x%X)", msc_type, MSC_CNT);
+    return Error(ERROR_MSC_RANGE);
+  }
+  if (const int status = RequireState(State::CONFIGURING)) {
+    return status;
+  }
+  if (const int status = EnableEventType(EV_MSC)) {
+    return status;
+  }
+  if (const int status = uinput_.IoctlSetInt(UI_SET_MSCBIT, msc_type)) {
+    ALOGE("failed to enable EV_MSC 0x%" PRIX16 "", msc_type);
+    return Error(status);
+  }
+  return 0;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::ConfigureForceFeedback(uint16_t ff_type,
+                                                       uint32_t effects_max) {
+  ALOGV("ConfigureForceFeedback 0x%" PRIX16 " %" PRIu32, ff_type, effects_max);
+  if (ff_type >= FF_CNT) {
+    ALOGE("EV_FF type 0x%" PRIX16 " out of range [0,0x%X)", ff_type, FF_CNT);
+    return Error(ERROR_FF_RANGE);
+  }
+  if (const int status = RequireState(State::CONFIGURING)) {
+    return status;
+  }
+  if (const int status = EnableEventType(EV_FF)) {
+    return status;
+  }
+  if (const int status = uinput_.IoctlSetInt(UI_SET_FFBIT, ff_type)) {
+    ALOGE("failed to enable EV_FF 0x%" PRIX16 "", ff_type);
+    return Error(status);
+  }
+  if (effects_max > uidev_.ff_effects_max) {
+    uidev_.ff_effects_max = effects_max;
+  }
+  return 0;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::ConfigureEnd() {
+  ALOGV("ConfigureEnd:");
+  ALOGV("  name=\"%s\"", uidev_.name);
+  ALOGV("  id.bustype=0x%04" PRIX16, uidev_.id.bustype);
+  ALOGV("  id.vendor=0x%04" PRIX16, uidev_.id.vendor);
+  ALOGV("  id.product=0x%04" PRIX16, uidev_.id.product);
+  ALOGV("  id.version=0x%04" PRIX16, uidev_.id.version);
+  ALOGV("  ff_effects_max=%" PRIu32, uidev_.ff_effects_max);
+  for (int i = 0; i < ABS_CNT; ++i) {
+    if (uidev_.absmin[i]) {
+      ALOGV("  absmin[%d]=%" PRId32, i, uidev_.absmin[i]);
+    }
+    if (uidev_.absmax[i]) {
+      ALOGV("  absmax[%d]=%" PRId32, i, uidev_.absmax[i]);
+    }
+    if (uidev_.absfuzz[i]) {
+      ALOGV("  absfuzz[%d]=%" PRId32, i, uidev_.absfuzz[i]);
+    }
+    if (uidev_.absflat[i]) {
+      ALOGV("  absflat[%d]=%" PRId32, i, uidev_.absflat[i]);
+    }
+  }
+
+  if (const int status = RequireState(State::CONFIGURING)) {
+    return status;
+  }
+  // Write out device settings.
+  if (const int status = uinput_.Write(&uidev_, sizeof uidev_)) {
+    ALOGE("failed to write device settings");
+    return Error(status);
+  }
+  // Create device node.
+  if (const int status = uinput_.IoctlVoid(UI_DEV_CREATE)) {
+    ALOGE("failed to create device node");
+    return Error(status);
+  }
+  state_ = State::READY;
+  return 0;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::Send(uint16_t type, uint16_t code, int32_t value) {
+  trace::Trace(trace::Point::InjectorSend, type, code, value);
+  std::lock_guard<std::mutex> lock(pending_mutex_);
+  if (const int status = RequireState(State::READY)) {
+    return status;
+  }
+  if (pending_count_ == pending_.size()) {
+    if (const int status = Flush()) {
+      return status;
+    }
+  }
+  struct input_event& event = pending_[pending_count_++];
+  memset(&event, 0, sizeof(event));
+  event.type = type;
+  event.code = code;
+  event.value = value;
+  if (type == EV_SYN && code == SYN_REPORT && batch_depth_ == 0) {
+    return Flush();
+  }
+  return 0;
+}
+
+template <typename Backend>
+void BasicEvdevInjector<Backend>::BeginBatch() {
+  std::lock_guard<std::mutex> lock(pending_mutex_);
+  batch_depth_++;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::EndBatch() {
+  std::lock_guard<std::mutex> lock(pending_mutex_);
+  if (batch_depth_ > 0 && --batch_depth_ == 0) {
+    return Flush();
+  }
+  return 0;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::Flush() {
+  if (pending_count_ == 0) {
+    return 0;
+  }
+  const size_t count = pending_count_;
+  pending_count_ = 0;
+  const uint64_t start = metrics::NowNs();
+  const int write_status = uinput_.WriteEvents(pending_.data(), count);
+  metrics::registry.injectorWrite.Record(metrics::NowNs() - start);
+  metrics::registry.injectorWrites.Add();
+  if (const int status = write_status) {
+    metrics::registry.injectorWriteErrors.Add();
+    ALOGE("failed to write %zu events", count);
+    return Error(status);
+  }
+  return 0;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::HandleFeedback() {
+  if (state_ != State::READY) {
+    return 0;
+  }
+  int handled = 0;
+  struct input_event event;
+  while (uinput_.Read(&event, sizeof(event)) == 0) {
+    handled++;
+    if (event.type == EV_UINPUT && event.code == UI_FF_UPLOAD) {
+      // We have nothing to play effects on, accepting them keeps clients happy.
+      struct uinput_ff_upload upload;
+      memset(&upload, 0, sizeof(upload));
+      upload.request_id = event.value;
+      if (uinput_.IoctlPtr(UI_BEGIN_FF_UPLOAD, &upload) == 0) {
+        upload.retval = 0;
+        uinput_.IoctlPtr(UI_END_FF_UPLOAD, &upload);
+      }
+    } else if (event.type == EV_UINPUT && event.code == UI_FF_ERASE) {
+      struct uinput_ff_erase erase;
+      memset(&erase, 0, sizeof(erase));
+      erase.request_id = event.value;
+      if (uinput_.IoctlPtr(UI_BEGIN_FF_ERASE, &erase) == 0) {
+        erase.retval = 0;
+        uinput_.IoctlPtr(UI_END_FF_ERASE, &erase);
+      }
+    } else if ((event.type == EV_FF || event.type == EV_LED) &&
+               feedback_callback_) {
+      feedback_callback_(event);
+    }
+  }
+  return handled;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::SendSynReport() { return Send(EV_SYN, SYN_REPORT, 0); }
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::SendKey(uint16_t code, int32_t value) {
+  return Send(EV_KEY, code, value);
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::SendAbs(uint16_t code, int32_t value) {
+  return Send(EV_ABS, code, value);
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::SendRel(uint16_t code, int32_t value) {
+  return Send(EV_REL, code, value);
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::SendMisc(uint16_t code, int32_t value) {
+  return Send(EV_MSC, code, value);
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::SendMultiTouchSlot(int32_t slot) {
+  if (latest_slot_ != slot) {
+    if (const int status = SendAbs(ABS_MT_SLOT, slot)) {
+      return status;
+    }
+    latest_slot_ = slot;
+  }
+  return 0;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::SendMultiTouchXY(int32_t slot, int32_t id,
+                                                 int32_t x, int32_t y) {
+  if (const int status = SendMultiTouchSlot(slot)) {
+    return status;
+  }
+  if (const int status = SendAbs(ABS_MT_TRACKING_ID, id)) {
+    return status;
+  }
+  if (const int status = SendAbs(ABS_MT_POSITION_X, x)) {
+    return status;
+  }
+  if (const int status = SendAbs(ABS_MT_POSITION_Y, y)) {
+    return status;
+  }
+  return 0;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::SendMultiTouchLift(int32_t slot) {
+  if (const int status = SendMultiTouchSlot(slot)) {
+    return status;
+  }
+  if (const int status = SendAbs(ABS_MT_TRACKING_ID, -1)) {
+    return status;
+  }
+  return 0;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::Error(int code) {
+  if (!error_) {
+    error_ = code;
+  }
+  return code;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::RequireState(State required_state) {
+  if (error_) {
+    return error_;
+  }
+  if (state_ != required_state) {
+    ALOGE("in state %d but require state %d", static_cast<int>(state_),
+          static_cast<int>(required_state));
+    return Error(ERROR_SEQUENCING);
+  }
+  return 0;
+}
+
+template <typename Backend>
+int BasicEvdevInjector<Backend>::EnableEventType(uint16_t type) {
+  if (const int status = RequireState(State::CONFIGURING)) {
+    return status;
+  }
+  if (enabled_event_types_.count(type) > 0) {
+    return 0;
+  }
+  if (const int status = uinput_.IoctlSetInt(UI_SET_EVBIT, type)) {
+    ALOGE("failed to enable event type 0x%X", type);
+    return Error(status);
+  }
+  enabled_event_types_.insert(type);
+  return 0;
+}
+
+}  // namespace inputhook
+
+#endif  // INPUTHOOK_EVDEV_INJECTOR_IMPL_H
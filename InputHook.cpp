@@ -18,9 +18,18 @@
 
 // #define LOG_NDEBUG 0
 
+#include <android-base/unique_fd.h>
 #include <android/log.h>
+#include <cutils/properties.h>
+#include <fcntl.h>
+#include <linux/input.h>
 #include <log/log.h>
+#include <sys/ioctl.h>
+#include "Allocations.h"
+#include "Config.h"
 #include "InputHook.h"
+#include "Metrics.h"
+#include "Trace.h"
 
 namespace vendor {
 namespace nvidia {
@@ -30,7 +39,11 @@ namespace inputflinger {
 namespace V2_0 {
 namespace implementation {
 
-InputHook::InputHook() : mRsMouse(mDeviceDb) {}
+InputHook::InputHook() : mReactor(SchedPolicy::FromProperties()), mProbe(mReactor), mTunables(mReactor), mVirtualDevices(mReactor, mProbe), mMacroEngine(mReactor, mVirtualDevices), mRsMouse(mDeviceDb, mReactor, mProbe, mVirtualDevices) {
+    mRemapper.LoadProfiles((std::string{config::Dir} + "/remap.conf").c_str());
+    mMacroEngine.LoadProfiles((std::string{config::Dir} + "/macros.conf").c_str());
+    mTunables.Load();
+}
 
 status_t InputHook::registerAsSystemService() {
     status_t ret{IInputHook::registerAsService()};
@@ -45,6 +58,82 @@ fail:
     return ret;
 }
 
+void InputHook::addDevice(int32_t id, int32_t vendor, int32_t product, RightStickAxes rightStick, const char *path) {
+    mDeviceDb.AddDevice(id, vendor, product);
+    metrics::registry.AddDevice(id);
+    mRemapper.AddDevice(id, vendor, product);
+    mMacroEngine.AddDevice(id, vendor, product);
+    if (!mDeviceDb.at(id).blacklisted)
+        mRsMouse.AddDevice(id, rightStick, path);
+    mSnapshot.AddDevice(id, vendor, product, path);
+}
+
+void InputHook::removeDevice(int32_t id) {
+    mDeviceDb.RemoveDevice(id);
+    metrics::registry.RemoveDevice(id);
+    mRemapper.RemoveDevice(id);
+    mMacroEngine.RemoveDevice(id);
+    mRsMouse.RemoveDevice(id);
+    mSnapshot.RemoveDevice(id);
+}
+
+void InputHook::registerFeatures() {
+    if (mRegistered)
+        return;
+
+    // InputFlinger is only up once /data is mounted, so from here on the persistent properties are loaded as well
+    mRegistered = true;
+    auto schedPolicy{SchedPolicy::FromProperties()};
+    mReactor.SetSchedPolicy(schedPolicy);
+    // This runs on the service's only HIDL thread, from registerDevices or from main() before it joins the thread pool. Clicks and
+    // pass-through events are injected from filterEvent on that thread, so it gets the same policy as the reactor
+    auto applied{schedPolicy.Apply()};
+    metrics::registry.hidlSchedPolicy.store(applied.KindName(), std::memory_order_relaxed);
+    metrics::registry.hidlSchedPriority.store(applied.priority, std::memory_order_relaxed);
+    mVirtualDevices.LoadBudget();
+    alloc::SetStrict(property_get_bool("persist.vendor.inputhook.alloc.strict", false) != 0);
+    if (property_get_bool("persist.vendor.inputhook.trace", false))
+        trace::SetEnabled(true); // Only ever enabled here so an earlier trace start isn't undone
+    mTunables.Watch();
+    mRsMouse.Register();
+    mMacroEngine.Register();
+    mSnapshot.SetRegistered();
+}
+
+void InputHook::restoreSnapshot() {
+    auto start{metrics::NowNs()};
+    auto state{mSnapshot.Open()};
+    if (!state)
+        return;
+
+    uint32_t restored{};
+    for (uint32_t i{}; i < state->deviceCount; i++) {
+        auto &device{state->devices[i]};
+        // The device may have been unplugged, or its node reused by another one, while the service was down
+        android::base::unique_fd fd{open(device.path, O_RDONLY | O_CLOEXEC)};
+        input_id inputId{};
+        if (fd.get() < 0 || ioctl(fd.get(), EVIOCGID, &inputId) || inputId.vendor != device.vendor || inputId.product != device.product) {
+            ALOGI("Not restoring device %d, %s is gone", device.id, device.path);
+            continue;
+        }
+
+        addDevice(device.id, device.vendor, device.product, RsMouse::FindRightStick(fd.get()), device.path);
+        restored++;
+    }
+
+    if (state->registered)
+        registerFeatures();
+    if (state->rsMouseDisabled) {
+        mRsMouse.SetDisabled(true);
+        mSnapshot.SetRsMouseDisabled(true);
+    }
+
+    auto elapsed{metrics::NowNs() - start};
+    metrics::registry.restoreTime.store(elapsed, std::memory_order_relaxed);
+    metrics::registry.restoredDevices.store(restored, std::memory_order_relaxed);
+    ALOGI("Restored %u of %u devices from the previous instance in %.3f ms", restored, state->deviceCount, elapsed / 1000000.0);
+}
+
 // Methods from ::vendor::nvidia::hardware::shieldtech::inputflinger::V2_0::IInputHook follow.
 Return<bool> InputHook::init(const ::android::sp<IInputHookCallback> &inputHookCallback) {
     ALOGI("InputHook::init");
@@ -58,14 +147,22 @@ Return<bool> InputHook::init(const ::android::sp<IInputHookCallback> &inputHookC
 }
 
 Return<void> InputHook::filterNewDevice(const hidl_handle& fd, int32_t id, const hidl_string& path, const InputIdentifier& identifier, IInputHook::filterNewDevice_cb _hidl_cb) {
+    metrics::ScopedLatency latency{metrics::registry.filterNewDevice};
+
     if (fd->numFds <= 0) {
 		_hidl_cb(false, identifier.name);
 		return Void();
 	}
 
-    ALOGI("InputHook::filterNewDevice: fd: %d, id: %d, path: %s, identifier: { vendor: %x product: %x name: %s uniqueId: %s }", fd->data[0], id, path.c_str(), identifier.vendor, identifier.product, identifier.name.c_str(), identifier.uniqueId.c_str());
+    trace::Trace(trace::Point::NewDevice, id, identifier.vendor, identifier.product);
+    ALOGV("InputHook::filterNewDevice: fd: %d, id: %d, path: %s, identifier: { vendor: %x product: %x name: %s uniqueId: %s }", fd->data[0], id, path.c_str(), identifier.vendor, identifier.product, identifier.name.c_str(), identifier.uniqueId.c_str());
 
-    mDeviceDb.AddDevice(id, identifier.vendor, identifier.product);
+    // A device that was restored from the snapshot is already set up, unless InputFlinger was restarted too and it comes back under a new ID
+    auto restored{mSnapshot.FindByPath(path.c_str())};
+    if (restored && *restored != id)
+        removeDevice(*restored);
+    if (restored != id)
+        addDevice(id, identifier.vendor, identifier.product, RsMouse::FindRightStick(fd->data[0]), path.c_str());
 
     _hidl_cb(true, identifier.name);
 
@@ -73,19 +170,35 @@ Return<void> InputHook::filterNewDevice(const hidl_handle& fd, int32_t id, const
 }
 
 Return<void> InputHook::filterCloseDevice(int32_t id) {
-    ALOGI("InputHook::filterCloseDevice: id: %d", id);
+    metrics::ScopedLatency latency{metrics::registry.filterCloseDevice};
 
-    mDeviceDb.RemoveDevice(id);
+    trace::Trace(trace::Point::CloseDevice, id);
+    ALOGV("InputHook::filterCloseDevice: id: %d", id);
+
+    removeDevice(id);
 
     return Void();
 }
 
 Return<void> InputHook::filterEvent(const HidlInputEvent& iev, int32_t deviceId, IInputHook::filterEvent_cb _hidl_cb) {
-    auto filterIev{iev};
+    metrics::ScopedLatency latency{metrics::registry.filterEvent};
+    HidlInputEvent filterIev{};
     auto response{Response::EVENT_DEFAULT};
 
-    if (!mDeviceDb.at(deviceId).blacklisted) {
-        response = mRsMouse.FilterEvent(filterIev, deviceId);
+    {
+        alloc::Scope noAllocations{alloc::Path::FilterEvent}; // The reply is marshalled by HIDL, so it isn't covered
+        metrics::registry.CountEvent(deviceId);
+        filterIev = iev;
+        if (!mDeviceDb.at(deviceId).blacklisted) {
+            metrics::registry.MarkHandled(latency.Start());
+            response = mRemapper.FilterEvent(filterIev, deviceId);
+            if (response == Response::EVENT_DEFAULT)
+                response = mMacroEngine.FilterEvent(filterIev, deviceId);
+            if (response == Response::EVENT_DEFAULT)
+                response = mRsMouse.FilterEvent(filterIev, deviceId, latency.Start());
+            if (mRsMouse.Disabled() != mSnapshot.RsMouseDisabled())
+                mSnapshot.SetRsMouseDisabled(mRsMouse.Disabled());
+        }
     }
 
     _hidl_cb(response, deviceId, filterIev);
@@ -94,21 +207,32 @@ Return<void> InputHook::filterEvent(const HidlInputEvent& iev, int32_t deviceId,
 };
 
 Return<bool> InputHook::notifyKeyState(int32_t deviceId, int32_t keyCode, bool handled) {
+    metrics::ScopedLatency latency{metrics::registry.notifyKeyState};
+
     return false;
 }
 
 
 Return<bool> InputHook::notifyMotionState(int32_t deviceId, const AnalogCoords &pc, bool handled) {
+    metrics::ScopedLatency latency{metrics::registry.notifyMotionState};
+    alloc::Scope noAllocations{alloc::Path::NotifyMotionState};
+    metrics::registry.CountMotion(deviceId);
+
     if (mDeviceDb.at(deviceId).blacklisted)
         return false;
 
-    return mRsMouse.NotifyMotionState(deviceId, pc, handled);
+    metrics::registry.MarkHandled(latency.Start());
+    return mRsMouse.NotifyMotionState(deviceId, pc, handled, latency.Start());
 }
 
 Return<void> InputHook::registerDevices() {
+    metrics::ScopedLatency latency{metrics::registry.registerDevices};
+
     ALOGI("InputHook::registerDevices");
 
-    mRsMouse.Register();
+    if (mRegistered)
+        ALOGI("Already registered, the state of the previous instance was restored");
+    registerFeatures();
 
     return Void();
 }
@@ -117,6 +241,49 @@ Return<bool> InputHook::treatMouseAsTouch() {
     return false;
 }
 
+// Methods from ::android::hidl::base::V1_0::IBase follow.
+Return<void> InputHook::debug(const hidl_handle &fd, const hidl_vec<hidl_string> &options) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1)
+        return Void();
+
+    int out{fd->data[0]};
+    if (options.size() >= 2 && std::string{options[0]} == "trace") {
+        std::string command{options[1]};
+        if (command == "start") {
+            trace::SetEnabled(false);
+            trace::Clear();
+            trace::SetEnabled(true);
+        } else if (command == "stop") {
+            trace::SetEnabled(false);
+        } else if (command == "dump") {
+            trace::Export(out);
+        } else {
+            dprintf(out, "Unknown trace command: %s\n", command.c_str());
+        }
+        return Void();
+    }
+
+    if (options.size() >= 2 && std::string{options[0]} == "probe") {
+        std::string command{options[1]};
+        if (command == "start")
+            mProbe.Start();
+        else if (command == "stop")
+            mProbe.Stop();
+        else
+            dprintf(out, "Unknown probe command: %s\n", command.c_str());
+        return Void();
+    }
+
+    metrics::registry.Dump(out);
+    alloc::Dump(out);
+    mVirtualDevices.Dump(out);
+    mSnapshot.Dump(out);
+    mTunables.Dump(out);
+    mProbe.Dump(out);
+
+    return Void();
+}
+
 }  // namespace implementation
 }  // namespace V2_0
 }  // namespace inputflinger
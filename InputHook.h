@@ -21,6 +21,13 @@
 #include "Common.h"
 #include "RsMouse.h"
 #include "DeviceDb.h"
+#include "LatencyProbe.h"
+#include "MacroEngine.h"
+#include "Reactor.h"
+#include "Remapper.h"
+#include "StateSnapshot.h"
+#include "Tunables.h"
+#include "VirtualDevices.h"
 
 namespace vendor {
 namespace nvidia {
@@ -35,12 +42,25 @@ using namespace inputhook;
 
 struct InputHook : public IInputHook {
     ::android::sp<IInputHookCallback> mInputHookCallback;
+    Reactor mReactor; //!< Must outlive every feature below as they hold handles into it
+    LatencyProbe mProbe;
+    TunablesWatcher mTunables;
     DeviceDb mDeviceDb;
+    VirtualDevices mVirtualDevices; //!< Must outlive every feature below as they lease devices from it
+    Remapper mRemapper;
+    MacroEngine mMacroEngine;
     RsMouse mRsMouse;
+    StateSnapshot mSnapshot; //!< Lets a restarted service pick up the devices and state of the previous instance
+    bool mRegistered{};
 
     InputHook();
     status_t registerAsSystemService();
 
+    void addDevice(int32_t id, int32_t vendor, int32_t product, RightStickAxes rightStick, const char *path);
+    void removeDevice(int32_t id);
+    void registerFeatures();
+    void restoreSnapshot();
+
     // Methods from ::vendor::nvidia::hardware::shieldtech::inputflinger::V2_0::IInputHook follow.
     Return<bool> init(const ::android::sp<IInputHookCallback> &inputHookCallback) override;
     Return<void> filterNewDevice(const hidl_handle &fd, int32_t id, const hidl_string& path, const InputIdentifier &identifier, IInputHook::filterNewDevice_cb _hidl_cb) override;
@@ -50,6 +70,9 @@ struct InputHook : public IInputHook {
     Return<bool> notifyMotionState(int32_t deviceId, const AnalogCoords &pc, bool handled) override;
     Return<void> registerDevices() override;
     Return<bool> treatMouseAsTouch() override;
+
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle &fd, const hidl_vec<hidl_string> &options) override;
 };
 
 }  // namespace implementation
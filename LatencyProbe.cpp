@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LatencyProbe"
+
+// #define LOG_NDEBUG 0
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <android/log.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <log/log.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "LatencyProbe.h"
+
+namespace inputhook {
+
+LatencyProbe::LatencyProbe(Reactor &reactor) : mReactor(reactor) {}
+
+LatencyProbe::~LatencyProbe() {
+    std::scoped_lock lock{mMutex};
+    CloseReader();
+}
+
+void LatencyProbe::OpenReader() {
+    if (!mInjector || mReaderHandle)
+        return;
+
+    int fd{-1};
+#if defined(INPUTHOOK_UINPUT_LOOPBACK)
+    fd = mInjector->GetUInput().GetReadFd();
+#else
+    // Find the evdev node that the kernel created for the uinput device
+    char sysName[64]{};
+    if (ioctl(mInjector->GetFd(), UI_GET_SYSNAME(sizeof(sysName)), sysName) < 0) {
+        ALOGE("Failed to get the uinput device name: %d", errno);
+        return;
+    }
+
+    std::string sysPath{std::string{"/sys/devices/virtual/input/"} + sysName};
+    if (DIR *dir{opendir(sysPath.c_str())}) {
+        while (dirent *entry{readdir(dir)}) {
+            if (!strncmp(entry->d_name, "event", 5)) {
+                mReaderFd.reset(open((std::string{"/dev/input/"} + entry->d_name).c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC));
+                break;
+            }
+        }
+        closedir(dir);
+    }
+
+    if (mReaderFd.get() < 0) {
+        ALOGE("Failed to open the evdev node of %s (%d), a uinput_backend=loopback build can be used instead", sysName, errno);
+        return;
+    }
+
+    int clock{CLOCK_MONOTONIC};
+    ioctl(mReaderFd.get(), EVIOCSCLOCKID, &clock);
+    fd = mReaderFd.get();
+#endif
+
+    mReaderHandle = mReactor.AddFd(fd, EPOLLIN, [this, fd](uint32_t) { OnReadable(fd); });
+}
+
+void LatencyProbe::CloseReader() {
+    mReactor.RemoveFd(mReaderHandle);
+    mReaderHandle = {};
+    mReaderFd.reset();
+}
+
+void LatencyProbe::OnReadable(int fd) {
+    input_event events[64];
+    ssize_t size;
+    while ((size = read(fd, events, sizeof(events))) > 0) {
+        auto now{metrics::NowNs()};
+        for (size_t i{}; i < static_cast<size_t>(size) / sizeof(input_event); i++) {
+            auto &event{events[i]};
+            if (event.type != EV_MSC || event.code != MSC_SERIAL)
+                continue;
+
+            auto &pending{mPending[static_cast<size_t>(event.value) % mPending.size()]};
+            auto start{pending.start.exchange(0, std::memory_order_acquire)};
+            if (!start || pending.sequence.load(std::memory_order_relaxed) != event.value) {
+                mUnmatched.Add();
+                continue;
+            }
+
+            auto &histograms{mHistograms[static_cast<size_t>(pending.path.load(std::memory_order_relaxed))]};
+            auto kernelTime{static_cast<uint64_t>(event.input_event_sec) * 1000000000ULL + static_cast<uint64_t>(event.input_event_usec) * 1000ULL};
+            histograms.kernel.Record(kernelTime > start ? kernelTime - start : 0);
+            histograms.readable.Record(now > start ? now - start : 0);
+        }
+    }
+}
+
+void LatencyProbe::Attach(EvdevInjector &injector) {
+    std::scoped_lock lock{mMutex};
+    CloseReader();
+    mInjector = &injector;
+    if (Active())
+        OpenReader();
+}
+
+void LatencyProbe::Detach(EvdevInjector &injector) {
+    std::scoped_lock lock{mMutex};
+    if (mInjector != &injector)
+        return;
+
+    CloseReader();
+    mInjector = nullptr;
+}
+
+void LatencyProbe::Start() {
+    std::scoped_lock lock{mMutex};
+    mActive = true;
+    OpenReader();
+}
+
+void LatencyProbe::Stop() {
+    std::scoped_lock lock{mMutex};
+    mActive = false;
+    CloseReader();
+}
+
+int32_t LatencyProbe::Tag(Path path, uint64_t start) {
+    auto sequence{mNextSequence.fetch_add(1, std::memory_order_relaxed) & INT32_MAX};
+    auto &pending{mPending[static_cast<size_t>(sequence) % mPending.size()]};
+    pending.path.store(path, std::memory_order_relaxed);
+    pending.sequence.store(sequence, std::memory_order_relaxed);
+    pending.start.store(start, std::memory_order_release);
+    return sequence;
+}
+
+void LatencyProbe::Dump(int fd) const {
+    constexpr const char *PathNames[]{"click", "tick"};
+
+    dprintf(fd, "Latency probe (%s, %s):\n", Active() ? "active" : "inactive", Loopback ? "loopback" : "evdev");
+    dprintf(fd, "  %-20s %10s %10s %10s %10s %10s %10s\n", "(us)", "count", "mean", "p50", "p90", "p99", "max");
+    for (size_t i{}; i < mHistograms.size(); i++) {
+        for (auto [stage, histogram] : {std::pair{"kernel", &mHistograms[i].kernel}, std::pair{"readable", &mHistograms[i].readable}}) {
+            std::string name{std::string{PathNames[i]} + " -> " + stage};
+            metrics::DumpHistogram(fd, name.c_str(), *histogram);
+        }
+    }
+    dprintf(fd, "  Unmatched: %" PRIu64 "\n", mUnmatched.Sum());
+}
+
+} // namespace inputhook
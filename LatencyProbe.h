@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_LATENCY_PROBE_H
+#define INPUTHOOK_LATENCY_PROBE_H
+
+#include <android-base/unique_fd.h>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+#include "EvdevInjector.h"
+#include "Metrics.h"
+#include "Reactor.h"
+
+namespace inputhook {
+
+/**
+ * @brief Measures the time from the hook receiving an input to the resulting frame being readable from the virtual device's evdev node
+ * @note Injected frames are tagged with an MSC_SERIAL sequence number right before their SYN_REPORT, which is matched back when it's read
+ */
+class LatencyProbe {
+  public:
+    enum class Path : uint8_t {
+        Click, //!< filterEvent -> RsMouse click
+        Tick, //!< notifyMotionState -> RsMouse cursor tick
+        Count,
+    };
+
+  private:
+    struct Pending {
+        std::atomic<uint64_t> start{}; //!< When the input was received, 0 if nothing is pending
+        std::atomic<int32_t> sequence{};
+        std::atomic<Path> path{};
+    };
+
+    struct PathHistograms {
+        metrics::Histogram kernel; //!< Until the timestamp the kernel stamped the event with
+        metrics::Histogram readable; //!< Until we read it back from the evdev node
+    };
+
+    Reactor &mReactor;
+    //! If injectors use the loopback stand-in of uinput rather than the real one, see the uinput_backend Soong config variable
+    static constexpr bool Loopback{std::is_same_v<EvdevInjector::UInput, LoopbackUInput>};
+
+    std::atomic_bool mActive{};
+    std::atomic<int32_t> mNextSequence{};
+    std::array<Pending, 256> mPending; //!< Indexed by the low bits of the sequence
+    std::array<PathHistograms, static_cast<size_t>(Path::Count)> mHistograms;
+    metrics::Counter mUnmatched; //!< Tags that were read back without a pending entry, this happens when the table wraps
+
+    std::mutex mMutex; //!< Protects everything below
+    EvdevInjector *mInjector{}; //!< The injector that's being probed
+    int mLoopbackFd{-1}; //!< The read end of the loopback stand-in for |mInjector|
+    android::base::unique_fd mReaderFd; //!< The evdev node of |mInjector|
+    Reactor::Handle mReaderHandle{};
+
+    void OpenReader();
+
+    void CloseReader();
+
+    void OnReadable(int fd);
+
+  public:
+    explicit LatencyProbe(Reactor &reactor);
+
+    ~LatencyProbe();
+
+    bool Active() const {
+        return mActive.load(std::memory_order_relaxed);
+    }
+
+    //! Probes the given injector from now on, it must have been configured with MSC_SERIAL
+    void Attach(EvdevInjector &injector);
+
+    void Detach(EvdevInjector &injector);
+
+    void Start();
+
+    void Stop();
+
+    /**
+     * @brief Registers a frame that's about to be injected, the returned tag must be sent as MSC_SERIAL before its SYN_REPORT
+     * @param start The CLOCK_MONOTONIC time in nanoseconds at which the input causing the frame was received
+     */
+    int32_t Tag(Path path, uint64_t start);
+
+    void Dump(int fd) const;
+};
+
+} // namespace inputhook
+
+#endif // INPUTHOOK_LATENCY_PROBE_H
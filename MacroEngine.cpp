@@ -0,0 +1,438 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "MacroEngine"
+
+// #define LOG_NDEBUG 0
+
+#include <set>
+#include <android/log.h>
+#include <log/log.h>
+#include "Config.h"
+#include "MacroEngine.h"
+#include "Metrics.h"
+
+namespace inputhook {
+namespace device {
+    constexpr const char *MacroName{"Input Hook Macros"};
+}
+
+namespace phase {
+    constexpr uint8_t Idle{0};
+    constexpr uint8_t HoldPending{1};
+    constexpr uint8_t HoldActive{2};
+    constexpr uint8_t TapDown{1}; //!< The first press of a double-tap
+    constexpr uint8_t TapArmed{2};
+    constexpr uint8_t TapActive{3};
+    constexpr uint8_t ChordWaiting{1};
+    constexpr uint8_t ChordPassthrough{2}; //!< The chord timed out so the first key is being held on its own
+    constexpr uint8_t ChordActive{3};
+    constexpr uint8_t TurboActive{1};
+    constexpr uint8_t MacroRunning{1};
+}
+
+constexpr uint64_t NsPerTick{1000000}; //!< The wheel runs at a millisecond granularity
+
+MacroEngine::MacroEngine(Reactor &reactor, VirtualDevices &devices) : mReactor(reactor), mVirtualDevices(devices), mEpoch(metrics::NowNs()) {}
+
+MacroEngine::~MacroEngine() {
+    mReactor.RemoveTimer(mTimer);
+}
+
+uint64_t MacroEngine::Now() const {
+    return (metrics::NowNs() - mEpoch) / NsPerTick;
+}
+
+void MacroEngine::OnWheelTimer() {
+    std::scoped_lock lock{mMutex};
+    if (mArmedWakeup) {
+        auto deadline{mEpoch + mArmedWakeup * NsPerTick}, now{metrics::NowNs()};
+        metrics::registry.macroTimerLateness.Record(now > deadline ? now - deadline : 0);
+    }
+
+    mArmedWakeup = 0; // The timerfd is one-shot
+    mWheel.Advance(Now());
+    Rearm();
+}
+
+void MacroEngine::Rearm() {
+    if (!mTimer)
+        return;
+
+    auto wakeup{mWheel.NextWakeup().value_or(0)};
+    if (wakeup == mArmedWakeup)
+        return;
+
+    Reactor::ArmTimer(mTimer, wakeup ? mEpoch + wakeup * NsPerTick : 0);
+    mArmedWakeup = wakeup;
+}
+
+void MacroEngine::Schedule(TimerWheel::Timer &timer, uint32_t delay) {
+    // The wheel lags behind real time between wakeups, bring it up to date so the delay is measured from now
+    mWheel.Advance(Now());
+    mWheel.Schedule(timer, delay);
+}
+
+void MacroEngine::Press(RuleState &state, uint16_t key) {
+    Release(state);
+
+    if (mRegistered) {
+        mInjector->SendKey(key, EvdevInjector::KEY_PRESS);
+        mInjector->SendSynReport();
+    }
+    state.heldKey = key;
+}
+
+void MacroEngine::Release(RuleState &state) {
+    if (!state.heldKey)
+        return;
+
+    if (mRegistered) {
+        mInjector->SendKey(state.heldKey, EvdevInjector::KEY_RELEASE);
+        mInjector->SendSynReport();
+    }
+    state.heldKey = 0;
+}
+
+void MacroEngine::Tap(uint16_t key) {
+    if (!mRegistered)
+        return;
+
+    mInjector->BeginBatch(); // Both frames go out in one write
+    mInjector->SendKey(key, EvdevInjector::KEY_PRESS);
+    mInjector->SendSynReport();
+    mInjector->SendKey(key, EvdevInjector::KEY_RELEASE);
+    mInjector->SendSynReport();
+    mInjector->EndBatch();
+}
+
+void MacroEngine::OnTimer(const MacroRule &rule, RuleState &state) {
+    switch (rule.kind) {
+        case MacroRule::Kind::Hold:
+            if (state.phase == phase::HoldPending) {
+                Press(state, rule.output);
+                state.phase = phase::HoldActive;
+            }
+            break;
+
+        case MacroRule::Kind::DoubleTap:
+            if (state.phase == phase::TapArmed)
+                state.phase = phase::Idle;
+            break;
+
+        case MacroRule::Kind::Chord:
+            if (state.phase == phase::ChordWaiting) {
+                Press(state, state.firstKey ? rule.otherKey : rule.key);
+                state.phase = phase::ChordPassthrough;
+            }
+            break;
+
+        case MacroRule::Kind::Turbo:
+            if (state.heldKey)
+                Release(state);
+            else
+                Press(state, rule.key);
+            mWheel.Schedule(state.timer, rule.time);
+            break;
+
+        case MacroRule::Kind::Macro:
+            Tap(rule.steps[state.step].key);
+            if (++state.step < rule.steps.size())
+                mWheel.Schedule(state.timer, rule.steps[state.step - 1].delay);
+            else
+                state.phase = phase::Idle;
+            break;
+    }
+}
+
+Response MacroEngine::OnKey(const MacroRule &rule, RuleState &state, uint16_t code, int32_t value) {
+    bool press{value == EvdevInjector::KEY_PRESS};
+    bool release{value == EvdevInjector::KEY_RELEASE};
+
+    switch (rule.kind) {
+        case MacroRule::Kind::Hold:
+            if (press && state.phase == phase::Idle) {
+                state.phase = phase::HoldPending;
+                Schedule(state.timer, rule.time);
+            } else if (release && state.phase == phase::HoldPending) {
+                mWheel.Cancel(state.timer);
+                Tap(rule.key);
+                state.phase = phase::Idle;
+            } else if (release && state.phase == phase::HoldActive) {
+                Release(state);
+                state.phase = phase::Idle;
+            }
+            return Response::EVENT_SKIP;
+
+        case MacroRule::Kind::DoubleTap:
+            if (press && state.phase == phase::Idle) {
+                state.phase = phase::TapDown;
+            } else if (release && state.phase == phase::TapDown) {
+                state.phase = phase::TapArmed;
+                Schedule(state.timer, rule.time);
+            } else if (press && state.phase == phase::TapArmed) {
+                mWheel.Cancel(state.timer);
+                Press(state, rule.output);
+                state.phase = phase::TapActive;
+            } else if (state.phase == phase::TapActive) {
+                if (release) {
+                    Release(state);
+                    state.phase = phase::Idle;
+                }
+                return Response::EVENT_SKIP;
+            }
+            return Response::EVENT_DEFAULT; // The first tap is never delayed
+
+        case MacroRule::Kind::Chord: {
+            uint8_t index{static_cast<uint8_t>(code == rule.key ? 0 : 1)};
+            uint8_t bit{static_cast<uint8_t>(1 << index)};
+            if (press)
+                state.keysDown |= bit;
+            else if (release)
+                state.keysDown &= ~bit;
+
+            if (state.phase == phase::Idle) {
+                if (!press)
+                    return Response::EVENT_DEFAULT; // A key that was let through while the other was held on its own
+
+                state.firstKey = index;
+                state.phase = phase::ChordWaiting;
+                Schedule(state.timer, rule.time);
+            } else if (state.phase == phase::ChordWaiting) {
+                if (press && index != state.firstKey) {
+                    mWheel.Cancel(state.timer);
+                    Press(state, rule.output);
+                    state.phase = phase::ChordActive;
+                } else if (release && index == state.firstKey) {
+                    mWheel.Cancel(state.timer);
+                    Tap(code);
+                    state.phase = phase::Idle;
+                }
+            } else if (state.phase == phase::ChordPassthrough) {
+                if (index != state.firstKey)
+                    return Response::EVENT_DEFAULT;
+
+                if (release) {
+                    Release(state);
+                    state.phase = phase::Idle;
+                }
+            } else if (state.phase == phase::ChordActive) {
+                Release(state);
+                if (!state.keysDown)
+                    state.phase = phase::Idle;
+            }
+            return Response::EVENT_SKIP;
+        }
+
+        case MacroRule::Kind::Turbo:
+            if (press && state.phase == phase::Idle) {
+                Press(state, rule.key);
+                state.phase = phase::TurboActive;
+                Schedule(state.timer, rule.time);
+            } else if (release && state.phase == phase::TurboActive) {
+                mWheel.Cancel(state.timer);
+                Release(state);
+                state.phase = phase::Idle;
+            }
+            return Response::EVENT_SKIP;
+
+        case MacroRule::Kind::Macro:
+            if (press && state.phase == phase::Idle) {
+                state.phase = phase::MacroRunning;
+                state.step = 0;
+                mWheel.Advance(Now());
+                OnTimer(rule, state);
+            }
+            return Response::EVENT_SKIP;
+    }
+
+    return Response::EVENT_DEFAULT;
+}
+
+void MacroEngine::Reset(RuleState &state) {
+    mWheel.Cancel(state.timer);
+    Release(state);
+}
+
+void MacroEngine::LoadProfiles(const char *path) {
+    MacroProfile *profile{};
+
+    bool found{config::ForEachLine(path, [&](const std::vector<std::string_view> &tokens, int lineNo) {
+        std::vector<int32_t> args(tokens.size() - 1);
+        for (size_t i{1}; i < tokens.size(); i++) {
+            if (!config::ParseInt(tokens[i], args[i - 1])) {
+                ALOGE("%s:%d: Invalid number", path, lineNo);
+                return;
+            }
+        }
+
+        for (auto arg : args) {
+            if (arg < 0 || (tokens[0] != "device" && arg > UINT16_MAX)) {
+                ALOGE("%s:%d: Value out of range", path, lineNo);
+                return;
+            }
+        }
+
+        auto &directive{tokens[0]};
+        if (directive == "device" && args.size() == 2) {
+            profile = &mProfiles[config::ProfileId(args[0], args[1])];
+            return;
+        } else if (!profile) {
+            ALOGE("%s:%d: Rule is not inside of a device block", path, lineNo);
+            return;
+        }
+
+        MacroRule rule{};
+        if ((directive == "hold" || directive == "double_tap") && args.size() == 3) {
+            rule.kind = directive == "hold" ? MacroRule::Kind::Hold : MacroRule::Kind::DoubleTap;
+            rule.key = static_cast<uint16_t>(args[0]);
+            rule.time = static_cast<uint32_t>(args[1]);
+            rule.output = static_cast<uint16_t>(args[2]);
+        } else if (directive == "chord" && args.size() == 4) {
+            rule.kind = MacroRule::Kind::Chord;
+            rule.key = static_cast<uint16_t>(args[0]);
+            rule.otherKey = static_cast<uint16_t>(args[1]);
+            rule.time = static_cast<uint32_t>(args[2]);
+            rule.output = static_cast<uint16_t>(args[3]);
+        } else if (directive == "turbo" && args.size() == 2) {
+            rule.kind = MacroRule::Kind::Turbo;
+            rule.key = static_cast<uint16_t>(args[0]);
+            rule.time = static_cast<uint32_t>(args[1]);
+        } else if (directive == "macro" && args.size() >= 3 && args.size() % 2 == 1) {
+            rule.kind = MacroRule::Kind::Macro;
+            rule.key = static_cast<uint16_t>(args[0]);
+            for (size_t i{1}; i < args.size(); i += 2)
+                rule.steps.push_back({static_cast<uint16_t>(args[i]), static_cast<uint32_t>(args[i + 1])});
+        } else {
+            ALOGE("%s:%d: Unknown directive", path, lineNo);
+            return;
+        }
+
+        bool valid{rule.key < KEY_CNT && rule.otherKey < KEY_CNT && rule.output < KEY_CNT};
+        for (auto &step : rule.steps)
+            valid &= step.key < KEY_CNT;
+        if (!valid) {
+            ALOGE("%s:%d: Key out of range", path, lineNo);
+            return;
+        }
+
+        if (profile->ruleForKey[rule.key] || (rule.otherKey && profile->ruleForKey[rule.otherKey]) || rule.key == rule.otherKey) {
+            ALOGE("%s:%d: Key already has a rule", path, lineNo);
+            return;
+        }
+
+        if (profile->rules.size() >= UINT8_MAX) {
+            ALOGE("%s:%d: Too many rules", path, lineNo);
+            return;
+        }
+
+        profile->rules.push_back(std::move(rule));
+        auto index{static_cast<uint8_t>(profile->rules.size())};
+        profile->ruleForKey[profile->rules.back().key] = index;
+        if (profile->rules.back().otherKey)
+            profile->ruleForKey[profile->rules.back().otherKey] = index;
+    })};
+
+    if (found)
+        ALOGI("Loaded %zu macro profiles from %s", mProfiles.size(), path);
+}
+
+void MacroEngine::Register() {
+    if (mRegistered)
+        LOG_FATAL("Cannot register MacroEngine twice!");
+
+    if (mProfiles.empty())
+        return;
+
+    // Every key that any rule can emit has to be declared upfront
+    std::set<uint16_t> keys;
+    for (auto &[id, profile] : mProfiles) {
+        for (auto &rule : profile.rules) {
+            keys.insert({rule.key, rule.output});
+            if (rule.otherKey)
+                keys.insert(rule.otherKey);
+            for (auto &step : rule.steps)
+                keys.insert(step.key);
+        }
+    }
+    keys.erase(0);
+
+    auto injector{mVirtualDevices.Acquire(profile::Keyboard(device::MacroName, {keys.begin(), keys.end()}))};
+    if (!injector) {
+        ALOGE("Failed to register MacroEngine");
+        return;
+    }
+
+    mTimer = mReactor.AddTimer({}, {}, [this](uint64_t) { OnWheelTimer(); });
+
+    std::scoped_lock lock{mMutex};
+    mInjector = std::move(injector);
+    mRegistered = true;
+    Rearm();
+}
+
+void MacroEngine::AddDevice(int32_t id, int32_t vid, int32_t pid) {
+    RemoveDevice(id);
+
+    auto profile{mProfiles.find(config::ProfileId(vid, pid))};
+    if (profile == mProfiles.end())
+        return;
+
+    std::scoped_lock lock{mMutex};
+    auto &device{mDevices.emplace(id, DeviceState{profile->second}).first->second};
+    for (size_t i{}; i < profile->second.rules.size(); i++) {
+        auto &rule{profile->second.rules[i]};
+        auto &state{device.rules[i]};
+        state.timer.callback = [this, &rule, &state]() { OnTimer(rule, state); };
+    }
+}
+
+void MacroEngine::RemoveDevice(int32_t id) {
+    std::scoped_lock lock{mMutex};
+    auto device{mDevices.find(id)};
+    if (device == mDevices.end())
+        return;
+
+    for (size_t i{}; i < device->second.profile.rules.size(); i++)
+        Reset(device->second.rules[i]);
+    mDevices.erase(device);
+    Rearm();
+}
+
+Response MacroEngine::FilterEvent(const HidlInputEvent &iev, int32_t deviceId) {
+    if (iev.type != EV_KEY || iev.code < 0 || iev.code >= KEY_CNT)
+        return Response::EVENT_DEFAULT;
+
+    std::scoped_lock lock{mMutex};
+    // Without the virtual keyboard the outputs can't be generated, so the original keys have to go through untouched
+    if (!mRegistered)
+        return Response::EVENT_DEFAULT;
+
+    auto device{mDevices.find(deviceId)};
+    if (device == mDevices.end())
+        return Response::EVENT_DEFAULT;
+
+    auto index{device->second.profile.ruleForKey[iev.code]};
+    if (!index)
+        return Response::EVENT_DEFAULT;
+
+    auto response{OnKey(device->second.profile.rules[index - 1], device->second.rules[index - 1], static_cast<uint16_t>(iev.code), iev.value)};
+    Rearm();
+
+    return response;
+}
+
+} // namespace inputhook
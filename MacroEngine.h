@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_MACRO_ENGINE_H
+#define INPUTHOOK_MACRO_ENGINE_H
+
+#include <array>
+#include <linux/input.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "EvdevInjector.h"
+#include "Reactor.h"
+#include "TimerWheel.h"
+#include "VirtualDevices.h"
+#include "Common.h"
+
+namespace inputhook {
+
+//! A timed behaviour bound to one (or two for chords) keys of a device
+struct MacroRule {
+    enum class Kind : uint8_t {
+        Hold, //!< Holding the key for longer than |time| presses |output| instead
+        DoubleTap, //!< A second press within |time| of the first release presses |output| instead
+        Chord, //!< Pressing |key| and |otherKey| within |time| of each other presses |output| instead
+        Turbo, //!< While the key is held it's toggled every |time|
+        Macro, //!< Pressing the key taps every step of |steps| in sequence
+    } kind;
+
+    struct Step {
+        uint16_t key;
+        uint32_t delay; //!< The delay in milliseconds after the tap before the next step
+    };
+
+    uint16_t key{};
+    uint16_t otherKey{};
+    uint16_t output{};
+    uint32_t time{}; //!< In milliseconds
+    std::vector<Step> steps;
+};
+
+struct MacroProfile {
+    std::array<uint8_t, KEY_CNT> ruleForKey{}; //!< An index + 1 into |rules| or 0 if the key has no rule
+    std::vector<MacroRule> rules;
+};
+
+/**
+ * @brief Implements hold, double-tap, chord, turbo and macro behaviours, all of their timing is handled by a single timer wheel
+ * @note The generated events are emitted through a separate virtual device as the source device can't be made to produce new events
+ */
+class MacroEngine {
+  private:
+    struct RuleState {
+        TimerWheel::Timer timer;
+        uint8_t phase{}; //!< Rule specific state machine position
+        uint8_t keysDown{}; //!< Bit 0 for |key|, bit 1 for |otherKey|
+        uint8_t firstKey{}; //!< The index of the key that started a chord
+        uint16_t heldKey{}; //!< The key we're holding down on the virtual device, if any
+        size_t step{}; //!< The next macro step
+    };
+
+    struct DeviceState {
+        const MacroProfile &profile;
+        std::unique_ptr<RuleState[]> rules; //!< Never resized as the timers are linked into the wheel
+
+        explicit DeviceState(const MacroProfile &profile) : profile(profile), rules(new RuleState[profile.rules.size()]) {}
+    };
+
+    std::unordered_map<uint32_t, MacroProfile> mProfiles; //!< Profiles keyed by their VID/PID
+    std::unordered_map<int32_t, DeviceState> mDevices;
+
+    Reactor &mReactor;
+    Reactor::Timer mTimer; //!< A one-shot timerfd that's kept armed for the next wakeup of the wheel
+    VirtualDevices &mVirtualDevices;
+
+    std::mutex mMutex; //!< Protects everything below, timer callbacks run on the reactor thread with this held
+    uint64_t mEpoch; //!< The CLOCK_MONOTONIC time in nanoseconds of tick 0 of the wheel
+    TimerWheel mWheel;
+    uint64_t mArmedWakeup{}; //!< The wheel tick that the timerfd is armed for or 0 if it's disarmed
+
+    VirtualDevices::Lease mInjector;
+    bool mRegistered{};
+
+    uint64_t Now() const;
+
+    void OnWheelTimer();
+
+    //! Rearms the timerfd if the next wakeup of the wheel has changed
+    void Rearm();
+
+    void Schedule(TimerWheel::Timer &timer, uint32_t delay);
+
+    void Press(RuleState &state, uint16_t key);
+
+    void Release(RuleState &state);
+
+    void Tap(uint16_t key);
+
+    void OnTimer(const MacroRule &rule, RuleState &state);
+
+    Response OnKey(const MacroRule &rule, RuleState &state, uint16_t code, int32_t value);
+
+    void Reset(RuleState &state);
+
+  public:
+    MacroEngine(Reactor &reactor, VirtualDevices &devices);
+
+    ~MacroEngine();
+
+    //! Loads all device profiles from the given config file, see README.md for the format
+    void LoadProfiles(const char *path);
+
+    //! Creates the virtual device used to emit generated events, this is skipped if no profiles are loaded
+    void Register();
+
+    void AddDevice(int32_t id, int32_t vid, int32_t pid);
+
+    void RemoveDevice(int32_t id);
+
+    Response FilterEvent(const HidlInputEvent &iev, int32_t deviceId);
+};
+
+} // namespace inputhook
+
+#endif // INPUTHOOK_MACRO_ENGINE_H
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include "Metrics.h"
+
+namespace inputhook {
+namespace metrics {
+
+Registry registry;
+
+size_t ThreadStripe() {
+    static std::atomic<size_t> nextStripe{};
+    thread_local size_t stripe{nextStripe.fetch_add(1, std::memory_order_relaxed) % Counter::Stripes};
+    return stripe;
+}
+
+uint64_t Counter::Sum() const {
+    uint64_t sum{};
+    for (auto &stripe : mStripes)
+        sum += stripe.value.load(std::memory_order_relaxed);
+    return sum;
+}
+
+Histogram::Summary Histogram::Summarise() const {
+    std::array<uint64_t, BucketCount> buckets;
+    uint64_t count{};
+    for (size_t i{}; i < BucketCount; i++) {
+        buckets[i] = mBuckets[i].load(std::memory_order_relaxed);
+        count += buckets[i];
+    }
+
+    Summary summary{.count = count};
+    if (!count)
+        return summary;
+
+    summary.mean = mSum.load(std::memory_order_relaxed) / count;
+
+    auto percentile{[&](uint64_t permille) {
+        uint64_t target{(count * permille + 999) / 1000}, seen{};
+        for (size_t i{}; i < BucketCount; i++) {
+            seen += buckets[i];
+            if (seen >= target)
+                return BucketValue(i);
+        }
+        return BucketValue(BucketCount - 1);
+    }};
+    summary.p50 = percentile(500);
+    summary.p90 = percentile(900);
+    summary.p99 = percentile(990);
+
+    for (size_t i{BucketCount}; i > 0; i--) {
+        if (buckets[i - 1]) {
+            summary.max = BucketValue(i - 1);
+            break;
+        }
+    }
+
+    return summary;
+}
+
+void Registry::AddDevice(int32_t id) {
+    if (Device(id))
+        return;
+
+    for (size_t i{}, slot{static_cast<size_t>(id) % MaxDevices}; i < MaxDevices; i++, slot = (slot + 1) % MaxDevices) {
+        auto slotId{devices[slot].id.load(std::memory_order_relaxed)};
+        if (slotId == DeviceCounters::FreeId || slotId == DeviceCounters::RemovedId) {
+            devices[slot].events.store(0, std::memory_order_relaxed);
+            devices[slot].motions.store(0, std::memory_order_relaxed);
+            devices[slot].coalesced.store(0, std::memory_order_relaxed);
+            devices[slot].id.store(id, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+void Registry::RemoveDevice(int32_t id) {
+    if (auto device{Device(id)})
+        device->id.store(DeviceCounters::RemovedId, std::memory_order_relaxed);
+}
+
+void DumpHistogram(int fd, const char *name, const Histogram &histogram) {
+    auto summary{histogram.Summarise()};
+    dprintf(fd, "  %-20s %10" PRIu64 " %10.1f %10.1f %10.1f %10.1f %10.1f\n", name, summary.count,
+            summary.mean / 1000.0, summary.p50 / 1000.0, summary.p90 / 1000.0, summary.p99 / 1000.0, summary.max / 1000.0);
+}
+
+void Registry::Dump(int fd) const {
+    dprintf(fd, "Latency (us):\n");
+    dprintf(fd, "  %-20s %10s %10s %10s %10s %10s %10s\n", "", "count", "mean", "p50", "p90", "p99", "max");
+    DumpHistogram(fd, "filterNewDevice", filterNewDevice);
+    DumpHistogram(fd, "filterCloseDevice", filterCloseDevice);
+    DumpHistogram(fd, "filterEvent", filterEvent);
+    DumpHistogram(fd, "notifyKeyState", notifyKeyState);
+    DumpHistogram(fd, "notifyMotionState", notifyMotionState);
+    DumpHistogram(fd, "registerDevices", registerDevices);
+    DumpHistogram(fd, "injectorWrite", injectorWrite);
+    DumpHistogram(fd, "cursorTick", cursorTick);
+    DumpHistogram(fd, "cursorTickLateness", cursorTickLateness);
+    DumpHistogram(fd, "macroTimerLateness", macroTimerLateness);
+    DumpHistogram(fd, "virtualDeviceCreate", virtualDeviceCreate);
+    DumpHistogram(fd, "directReadDelay", directReadDelay);
+    DumpHistogram(fd, "directLead", directLead);
+
+    dprintf(fd, "Reactor scheduling: %s %d, %" PRIu64 " wakeups\n", reactorSchedPolicy.load(std::memory_order_relaxed), reactorSchedPriority.load(std::memory_order_relaxed), reactorWakeups.Sum());
+    dprintf(fd, "HIDL thread scheduling: %s %d\n", hidlSchedPolicy.load(std::memory_order_relaxed), hidlSchedPriority.load(std::memory_order_relaxed));
+
+    auto start{serviceStart.load(std::memory_order_relaxed)}, ready{serviceReady.load(std::memory_order_relaxed)};
+    if (ready >= start)
+        dprintf(fd, "Startup: %.3f ms to ready\n", (ready - start) / 1000000.0);
+    if (auto first{firstHandledEvent.load(std::memory_order_relaxed)}; first >= start && first)
+        dprintf(fd, "First handled event: %.3f ms after start\n", (first - start) / 1000000.0);
+    if (auto restored{restoredDevices.load(std::memory_order_relaxed)})
+        dprintf(fd, "Warm restart: %u devices restored in %.3f ms\n", restored, restoreTime.load(std::memory_order_relaxed) / 1000000.0);
+
+    if (FILE *status{fopen("/proc/self/status", "re")}) {
+        char line[128];
+        while (fgets(line, sizeof(line), status)) {
+            if (!strncmp(line, "VmRSS:", 6) || !strncmp(line, "VmHWM:", 6) || !strncmp(line, "Threads:", 8))
+                dprintf(fd, "%s", line);
+        }
+        fclose(status);
+    }
+
+    dprintf(fd, "Injector: %" PRIu64 " writes, %" PRIu64 " failed\n", injectorWrites.Sum(), injectorWriteErrors.Sum());
+
+    dprintf(fd, "Devices:\n");
+    for (auto &device : devices) {
+        auto id{device.id.load(std::memory_order_relaxed)};
+        if (id >= 0)
+            dprintf(fd, "  %4d: %10" PRIu64 " events %10" PRIu64 " motions %10" PRIu64 " coalesced\n", id, device.events.load(std::memory_order_relaxed),
+                    device.motions.load(std::memory_order_relaxed), device.coalesced.load(std::memory_order_relaxed));
+    }
+    dprintf(fd, "  Untracked: %" PRIu64 " events\n", untrackedEvents.Sum());
+}
+
+} // namespace metrics
+} // namespace inputhook
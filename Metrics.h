@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_METRICS_H
+#define INPUTHOOK_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <time.h>
+
+namespace inputhook {
+namespace metrics {
+
+inline uint64_t NowNs() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+//! The stripe that the calling thread records into, stripes are handed out round-robin on first use
+size_t ThreadStripe();
+
+/**
+ * @brief A counter which is split into cache line sized stripes so concurrent writers never contend
+ * @note sched_getcpu is a full syscall on arm64 so stripes are picked per-thread rather than per-CPU, with our handful of threads this amounts to the same thing
+ */
+class Counter {
+  public:
+    static constexpr size_t Stripes{8};
+
+  private:
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> value{};
+    };
+
+    std::array<Stripe, Stripes> mStripes{};
+
+  public:
+    void Add(uint64_t count = 1) {
+        mStripes[ThreadStripe()].value.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    uint64_t Sum() const;
+};
+
+/**
+ * @brief A histogram with logarithmic buckets that are each split into linear sub-buckets, similar to HdrHistogram
+ * @note Recording is a bucket and a sum increment, there's no locking and readers may observe a slightly torn snapshot
+ */
+class Histogram {
+  public:
+    static constexpr int SubBucketBits{3}; //!< 8 sub-buckets per power of two, giving a worst case error of 12.5%
+    static constexpr size_t SubBucketCount{1U << SubBucketBits};
+    static constexpr size_t BucketCount{(64 - SubBucketBits + 1) * SubBucketCount};
+
+  private:
+    std::array<std::atomic<uint64_t>, BucketCount> mBuckets{};
+    std::atomic<uint64_t> mSum{};
+
+  public:
+    static size_t BucketIndex(uint64_t value) {
+        if (value < SubBucketCount)
+            return static_cast<size_t>(value);
+
+        int exponent{63 - __builtin_clzll(value)};
+        int shift{exponent - SubBucketBits};
+        return (static_cast<size_t>(shift + 1) << SubBucketBits) + static_cast<size_t>((value >> shift) & (SubBucketCount - 1));
+    }
+
+    //! @return The smallest value that lands in the given bucket
+    static uint64_t BucketValue(size_t index) {
+        if (index < SubBucketCount)
+            return index;
+
+        int shift{static_cast<int>(index >> SubBucketBits) - 1};
+        return (SubBucketCount | (index & (SubBucketCount - 1))) << shift;
+    }
+
+    void Record(uint64_t value) {
+        mBuckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        mSum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    struct Summary {
+        uint64_t count;
+        uint64_t mean;
+        uint64_t p50;
+        uint64_t p90;
+        uint64_t p99;
+        uint64_t max;
+    };
+
+    Summary Summarise() const;
+};
+
+/**
+ * @brief Records the time from construction to destruction into a histogram in nanoseconds
+ */
+class ScopedLatency {
+  private:
+    Histogram &mHistogram;
+    uint64_t mStart;
+
+  public:
+    explicit ScopedLatency(Histogram &histogram) : mHistogram(histogram), mStart(NowNs()) {}
+
+    ~ScopedLatency() {
+        mHistogram.Record(NowNs() - mStart);
+    }
+
+    uint64_t Start() const {
+        return mStart;
+    }
+};
+
+/**
+ * @brief Event counts for a single input device, slots are claimed on device addition so the hot path only hashes the ID
+ */
+struct DeviceCounters {
+    static constexpr int32_t FreeId{-1};
+    static constexpr int32_t RemovedId{-2}; //!< Keeps probe chains intact after a device is removed
+
+    std::atomic<int32_t> id{FreeId};
+    std::atomic<uint64_t> events{};
+    std::atomic<uint64_t> motions{};
+    std::atomic<uint64_t> coalesced{}; //!< Motion samples that were combined with an earlier one before a cursor tick consumed them
+};
+
+struct Registry {
+    // HIDL entry points
+    Histogram filterNewDevice;
+    Histogram filterCloseDevice;
+    Histogram filterEvent;
+    Histogram notifyKeyState;
+    Histogram notifyMotionState;
+    Histogram registerDevices;
+
+    // Injection
+    Histogram injectorWrite;
+    Counter injectorWrites;
+    Counter injectorWriteErrors;
+
+    Histogram cursorTick; //!< The time taken by each RsMouse tick
+    Histogram cursorTickLateness; //!< How much later than scheduled each RsMouse tick ran
+    Histogram macroTimerLateness; //!< How much later than the wheel's wakeup the MacroEngine timer ran
+    Histogram virtualDeviceCreate; //!< The time taken to configure and create a uinput device
+    Histogram directReadDelay; //!< From the kernel stamping a right stick frame to RsMouse reading it directly
+    Histogram directLead; //!< How much earlier a direct read saw a right stick position than notifyMotionState did
+
+    // Scheduling
+    Counter reactorWakeups; //!< Every return from the reactor's epoll_wait
+    std::atomic<const char *> reactorSchedPolicy{"default"};
+    std::atomic<int> reactorSchedPriority{};
+    std::atomic<const char *> hidlSchedPolicy{"default"}; //!< The thread InputFlinger's calls arrive on
+    std::atomic<int> hidlSchedPriority{};
+
+    // Process
+    std::atomic<uint64_t> serviceStart{}; //!< When main() was entered
+    std::atomic<uint64_t> serviceReady{}; //!< When the service was registered with hwservicemanager
+    std::atomic<uint64_t> firstHandledEvent{}; //!< When an event from a known device first reached the features
+    std::atomic<uint64_t> restoreTime{}; //!< How long restoring the previous instance's state took in nanoseconds
+    std::atomic<uint32_t> restoredDevices{};
+
+    static constexpr size_t MaxDevices{32};
+    std::array<DeviceCounters, MaxDevices> devices{};
+    Counter untrackedEvents; //!< Events from devices that didn't fit in |devices|
+
+    void AddDevice(int32_t id);
+
+    void RemoveDevice(int32_t id);
+
+    //! @return The counters for the given device or nullptr if it isn't tracked
+    DeviceCounters *Device(int32_t id) {
+        for (size_t i{}, slot{static_cast<size_t>(id) % MaxDevices}; i < MaxDevices; i++, slot = (slot + 1) % MaxDevices) {
+            auto slotId{devices[slot].id.load(std::memory_order_relaxed)};
+            if (slotId == id)
+                return &devices[slot];
+            else if (slotId == DeviceCounters::FreeId)
+                break;
+        }
+        return nullptr;
+    }
+
+    //! Records |now| as the time of the first handled event if there hasn't been one yet
+    void MarkHandled(uint64_t now) {
+        if (!firstHandledEvent.load(std::memory_order_relaxed))
+            firstHandledEvent.store(now, std::memory_order_relaxed);
+    }
+
+    void CountEvent(int32_t id) {
+        if (auto device{Device(id)})
+            device->events.fetch_add(1, std::memory_order_relaxed);
+        else
+            untrackedEvents.Add();
+    }
+
+    void CountMotion(int32_t id) {
+        if (auto device{Device(id)})
+            device->motions.fetch_add(1, std::memory_order_relaxed);
+        else
+            untrackedEvents.Add();
+    }
+
+    void CountCoalesced(int32_t id) {
+        if (auto device{Device(id)})
+            device->coalesced.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //! Writes a human readable dump of all metrics to the given fd
+    void Dump(int fd) const;
+};
+
+extern Registry registry;
+
+//! Writes a single row of the latency table that Registry::Dump prints, in microseconds
+void DumpHistogram(int fd, const char *name, const Histogram &histogram);
+
+} // namespace metrics
+} // namespace inputhook
+
+#endif // INPUTHOOK_METRICS_H
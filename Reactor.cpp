@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Reactor"
+
+// #define LOG_NDEBUG 0
+
+#include <cerrno>
+#include <future>
+#include <android/log.h>
+#include <log/log.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "Metrics.h"
+#include "Reactor.h"
+
+namespace inputhook {
+
+static timespec ToTimespec(uint64_t ns) {
+    return timespec{.tv_sec = static_cast<time_t>(ns / 1000000000ULL), .tv_nsec = static_cast<long>(ns % 1000000000ULL)};
+}
+
+Reactor::Reactor(SchedPolicy schedPolicy) : mEpollFd(epoll_create1(EPOLL_CLOEXEC)), mWakeFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)), mSchedPolicy(schedPolicy) {
+    if (mEpollFd.get() < 0 || mWakeFd.get() < 0)
+        LOG_ALWAYS_FATAL("Failed to create reactor fds: %d", errno);
+
+    epoll_event event{.events = EPOLLIN, .data = {.u64 = 0}}; // Handle 0 is reserved for the wakeup eventfd
+    if (epoll_ctl(mEpollFd.get(), EPOLL_CTL_ADD, mWakeFd.get(), &event))
+        LOG_ALWAYS_FATAL("Failed to watch reactor eventfd: %d", errno);
+
+    mThread = std::thread{&Reactor::ReactorMain, this};
+}
+
+Reactor::~Reactor() {
+    Post([this]() { mExiting = true; });
+
+    if (mThread.joinable())
+        mThread.join();
+}
+
+void Reactor::ReactorMain() {
+    ApplySchedPolicy();
+
+    constexpr int MaxEvents{16};
+    epoll_event events[MaxEvents];
+
+    while (!mExiting) {
+        int count{epoll_wait(mEpollFd.get(), events, MaxEvents, -1)};
+        if (count < 0) {
+            if (errno != EINTR)
+                ALOGE("epoll_wait failed: %d", errno);
+            continue;
+        }
+        metrics::registry.reactorWakeups.Add();
+
+        for (int i{}; i < count; i++) {
+            auto handle{events[i].data.u64};
+            if (handle == 0) {
+                uint64_t value;
+                read(mWakeFd.get(), &value, sizeof(value));
+                RunTasks();
+                continue;
+            }
+
+            // An earlier callback in this batch may have removed the handler
+            auto handler{mHandlers.find(handle)};
+            if (handler != mHandlers.end())
+                handler->second.callback(events[i].events);
+        }
+    }
+}
+
+void Reactor::ApplySchedPolicy() {
+    auto applied{mSchedPolicy.Apply()};
+    metrics::registry.reactorSchedPolicy.store(applied.KindName(), std::memory_order_relaxed);
+    metrics::registry.reactorSchedPriority.store(applied.priority, std::memory_order_relaxed);
+}
+
+void Reactor::SetSchedPolicy(SchedPolicy schedPolicy) {
+    Post([this, schedPolicy]() {
+        if (schedPolicy == mSchedPolicy)
+            return;
+
+        mSchedPolicy = schedPolicy;
+        ApplySchedPolicy();
+    });
+}
+
+void Reactor::RunTasks() {
+    std::unique_lock lock{mTasksMutex};
+    while (!mTasks.empty()) {
+        auto task{std::move(mTasks.front())};
+        mTasks.pop_front();
+
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+void Reactor::Post(std::function<void()> task) {
+    {
+        std::scoped_lock lock{mTasksMutex};
+        mTasks.push_back(std::move(task));
+    }
+
+    uint64_t value{1};
+    write(mWakeFd.get(), &value, sizeof(value));
+}
+
+void Reactor::Run(const std::function<void()> &task) {
+    if (InReactorThread()) {
+        task();
+        return;
+    }
+
+    std::promise<void> done;
+    Post([&]() {
+        task();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
+Reactor::Handle Reactor::AddHandler(int fd, android::base::unique_fd ownedFd, uint32_t events, FdCallback callback) {
+    Handle handle{};
+    Run([&]() {
+        epoll_event event{.events = events, .data = {.u64 = mNextHandle}};
+        if (epoll_ctl(mEpollFd.get(), EPOLL_CTL_ADD, fd, &event)) {
+            ALOGE("Failed to watch fd %d: %d", fd, errno);
+            return;
+        }
+
+        handle = mNextHandle++;
+        mHandlers.emplace(handle, Handler{fd, std::move(ownedFd), std::move(callback)});
+    });
+    return handle;
+}
+
+Reactor::Handle Reactor::AddFd(int fd, uint32_t events, FdCallback callback) {
+    return AddHandler(fd, {}, events, std::move(callback));
+}
+
+void Reactor::RemoveFd(Handle handle) {
+    if (!handle)
+        return;
+
+    Run([&]() {
+        auto handler{mHandlers.find(handle)};
+        if (handler == mHandlers.end())
+            return;
+
+        epoll_ctl(mEpollFd.get(), EPOLL_CTL_DEL, handler->second.fd, nullptr);
+        mHandlers.erase(handler);
+    });
+}
+
+Reactor::Timer Reactor::AddTimer(std::chrono::nanoseconds delay, std::chrono::nanoseconds period, TimerCallback callback) {
+    android::base::unique_fd timerFd{timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)};
+    if (timerFd.get() < 0) {
+        ALOGE("Failed to create timerfd: %d", errno);
+        return {};
+    }
+
+    itimerspec spec{.it_interval = ToTimespec(static_cast<uint64_t>(period.count())), .it_value = ToTimespec(static_cast<uint64_t>(delay.count()))};
+    if (timerfd_settime(timerFd.get(), 0, &spec, nullptr)) {
+        ALOGE("Failed to arm timerfd: %d", errno);
+        return {};
+    }
+
+    int fd{timerFd.get()};
+    auto handle{AddHandler(fd, std::move(timerFd), EPOLLIN, [fd, callback{std::move(callback)}](uint32_t) {
+        uint64_t expirations{};
+        if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations) && expirations)
+            callback(expirations);
+    })};
+
+    return handle ? Timer{handle, fd} : Timer{};
+}
+
+void Reactor::ArmTimer(const Timer &timer, uint64_t deadline) {
+    itimerspec spec{.it_interval = {}, .it_value = ToTimespec(deadline)};
+    if (timerfd_settime(timer.fd, TFD_TIMER_ABSTIME, &spec, nullptr))
+        ALOGE("Failed to arm timerfd: %d", errno);
+}
+
+} // namespace inputhook
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_REACTOR_H
+#define INPUTHOOK_REACTOR_H
+
+#include <android-base/unique_fd.h>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "SchedPolicy.h"
+
+namespace inputhook {
+
+/**
+ * @brief A single epoll thread that owns every fd, timer and wakeup of the service so features don't need threads of their own
+ * @note All handler registration is serialised onto the reactor thread, once a Remove* call returns its callback is guaranteed not to be running
+ */
+class Reactor {
+  public:
+    using Handle = uint64_t;
+    using FdCallback = std::function<void(uint32_t events)>;
+    using TimerCallback = std::function<void(uint64_t expirations)>;
+
+    struct Timer {
+        Handle handle{};
+        int fd{-1}; //!< The timerfd, this is only valid until the timer is removed
+
+        explicit operator bool() const {
+            return handle != 0;
+        }
+    };
+
+  private:
+    struct Handler {
+        int fd;
+        android::base::unique_fd ownedFd; //!< Set for timers, which the reactor creates itself
+        FdCallback callback;
+    };
+
+    android::base::unique_fd mEpollFd;
+    android::base::unique_fd mWakeFd; //!< An eventfd used to wake the thread up for posted tasks
+    std::thread mThread;
+    SchedPolicy mSchedPolicy; //!< The policy that was last requested for the reactor thread, only accessed on it once it's started
+    bool mExiting{}; //!< Only accessed on the reactor thread
+
+    std::mutex mTasksMutex;
+    std::deque<std::function<void()>> mTasks;
+
+    std::unordered_map<Handle, Handler> mHandlers; //!< Only accessed on the reactor thread
+    Handle mNextHandle{1};
+
+    void ReactorMain();
+
+    void RunTasks();
+
+    void ApplySchedPolicy();
+
+    Handle AddHandler(int fd, android::base::unique_fd ownedFd, uint32_t events, FdCallback callback);
+
+  public:
+    explicit Reactor(SchedPolicy schedPolicy = {});
+
+    ~Reactor();
+
+    Reactor(const Reactor &) = delete;
+
+    Reactor &operator=(const Reactor &) = delete;
+
+    bool InReactorThread() const {
+        return std::this_thread::get_id() == mThread.get_id();
+    }
+
+    //! Applies |schedPolicy| to the reactor thread if it differs from the current one
+    void SetSchedPolicy(SchedPolicy schedPolicy);
+
+    //! Queues a task to run on the reactor thread
+    void Post(std::function<void()> task);
+
+    //! Runs a task on the reactor thread and waits for it to finish, if called on the reactor thread it runs immediately
+    void Run(const std::function<void()> &task);
+
+    /**
+     * @brief Watches an fd that's owned by the caller, it must stay open until RemoveFd returns
+     * @param events The EPOLL* events to wait for
+     * @return A handle for RemoveFd or 0 on failure
+     */
+    Handle AddFd(int fd, uint32_t events, FdCallback callback);
+
+    void RemoveFd(Handle handle);
+
+    /**
+     * @brief Creates a timerfd that first fires after |delay| then every |period| if it's non-zero, a zero |delay| creates it disarmed
+     * @return An empty timer on failure
+     */
+    Timer AddTimer(std::chrono::nanoseconds delay, std::chrono::nanoseconds period, TimerCallback callback);
+
+    /**
+     * @brief Rearms a timer to fire once at the given CLOCK_MONOTONIC time in nanoseconds or disarms it if |deadline| is 0
+     * @note This is safe to call from any thread as long as the timer hasn't been removed
+     */
+    static void ArmTimer(const Timer &timer, uint64_t deadline);
+
+    void RemoveTimer(const Timer &timer) {
+        RemoveFd(timer.handle);
+    }
+};
+
+} // namespace inputhook
+
+#endif // INPUTHOOK_REACTOR_H
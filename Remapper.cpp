@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Remapper"
+
+// #define LOG_NDEBUG 0
+
+#include <iterator>
+#include <android/log.h>
+#include <log/log.h>
+#include "Config.h"
+#include "EvdevInjector.h"
+#include "Remapper.h"
+
+namespace inputhook {
+
+void Remapper::LoadProfiles(const char *path) {
+    RemapProfile *profile{};
+
+    bool found{config::ForEachLine(path, [&](const std::vector<std::string_view> &tokens, int lineNo) {
+        int32_t args[4]{};
+        for (size_t i{1}; i < tokens.size() && i <= std::size(args); i++) {
+            if (!config::ParseInt(tokens[i], args[i - 1])) {
+                ALOGE("%s:%d: Invalid number", path, lineNo);
+                return;
+            }
+        }
+
+        auto &directive{tokens[0]};
+        if (directive == "device" && tokens.size() == 3) {
+            profile = &mProfiles[config::ProfileId(args[0], args[1])];
+        } else if (!profile) {
+            ALOGE("%s:%d: Rule is not inside of a device block", path, lineNo);
+        } else if (directive == "key" && tokens.size() == 3) {
+            if (args[0] < 0 || args[0] >= KEY_CNT || args[1] < 0 || args[1] >= KEY_CNT) {
+                ALOGE("%s:%d: Key out of range", path, lineNo);
+                return;
+            }
+
+            profile->keys[args[0]] = {.type = EV_KEY, .code = static_cast<uint16_t>(args[1])};
+        } else if (directive == "key_axis" && tokens.size() == 5) {
+            if (args[0] < 0 || args[0] >= KEY_CNT || args[1] < 0 || args[1] >= ABS_CNT) {
+                ALOGE("%s:%d: Key or axis out of range", path, lineNo);
+                return;
+            }
+
+            profile->keys[args[0]] = {.type = EV_ABS, .code = static_cast<uint16_t>(args[1]), .pressValue = args[2], .releaseValue = args[3]};
+        } else if (directive == "axis_key" && tokens.size() == 5) {
+            if (args[0] < 0 || args[0] >= ABS_CNT || args[1] <= 0 || args[1] >= KEY_CNT) {
+                ALOGE("%s:%d: Axis or key out of range", path, lineNo);
+                return;
+            }
+
+            if (args[2] == args[3]) {
+                ALOGE("%s:%d: Press and release thresholds must differ", path, lineNo);
+                return;
+            }
+
+            profile->axes[args[0]] = {.key = static_cast<uint16_t>(args[1]), .pressAt = args[2], .releaseAt = args[3]};
+        } else {
+            ALOGE("%s:%d: Unknown directive", path, lineNo);
+        }
+    })};
+
+    if (found)
+        ALOGI("Loaded %zu remap profiles from %s", mProfiles.size(), path);
+}
+
+void Remapper::AddDevice(int32_t id, int32_t vid, int32_t pid) {
+    mDevices.erase(id);
+
+    auto profile{mProfiles.find(config::ProfileId(vid, pid))};
+    if (profile != mProfiles.end())
+        mDevices.emplace(id, DeviceState{profile->second});
+}
+
+void Remapper::RemoveDevice(int32_t id) {
+    mDevices.erase(id);
+}
+
+Response Remapper::FilterEvent(HidlInputEvent &iev, int32_t deviceId) {
+    auto device{mDevices.find(deviceId)};
+    if (device == mDevices.end())
+        return Response::EVENT_DEFAULT;
+
+    auto &state{device->second};
+    if (iev.type == EV_KEY && iev.code >= 0 && iev.code < KEY_CNT) {
+        auto &rule{state.profile.keys[iev.code]};
+        if (rule.type == EV_KEY) {
+            iev.code = rule.code;
+        } else if (rule.type == EV_ABS) {
+            if (iev.value == EvdevInjector::KEY_REPEAT)
+                return Response::EVENT_SKIP;
+
+            iev.type = EV_ABS;
+            iev.code = rule.code;
+            iev.value = iev.value ? rule.pressValue : rule.releaseValue;
+        }
+    } else if (iev.type == EV_ABS && iev.code >= 0 && iev.code < ABS_CNT) {
+        auto &rule{state.profile.axes[iev.code]};
+        if (!rule.key)
+            return Response::EVENT_DEFAULT;
+
+        uint64_t bit{1ULL << iev.code};
+        bool pressed{(state.axisPressed & bit) != 0};
+        bool positive{rule.pressAt > rule.releaseAt};
+        bool reached{positive ? iev.value >= rule.pressAt : iev.value <= rule.pressAt};
+        bool returned{positive ? iev.value <= rule.releaseAt : iev.value >= rule.releaseAt};
+
+        // Only the edges of the threshold produce key events, everything in between is swallowed
+        if (!pressed && reached)
+            state.axisPressed |= bit;
+        else if (pressed && returned)
+            state.axisPressed &= ~bit;
+        else
+            return Response::EVENT_SKIP;
+
+        iev.type = EV_KEY;
+        iev.code = rule.key;
+        iev.value = pressed ? EvdevInjector::KEY_RELEASE : EvdevInjector::KEY_PRESS;
+    }
+
+    return Response::EVENT_DEFAULT;
+}
+
+} // namespace inputhook
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_REMAPPER_H
+#define INPUTHOOK_REMAPPER_H
+
+#include <array>
+#include <linux/input.h>
+#include <unordered_map>
+#include "Common.h"
+
+namespace inputhook {
+
+//! A set of rewrite rules for a single kind of device, indexed directly by the incoming event code
+struct RemapProfile {
+    struct KeyRule {
+        uint16_t type{}; //!< EV_KEY for key->key, EV_ABS for key->axis or 0 to pass the key through untouched
+        uint16_t code{};
+        int32_t pressValue{}; //!< The axis value while the key is held (key->axis only)
+        int32_t releaseValue{}; //!< The axis value once the key is released (key->axis only)
+    };
+
+    struct AxisRule {
+        uint16_t key{}; //!< The key that the axis is turned into or 0 to pass the axis through untouched
+        int32_t pressAt{}; //!< The key is pressed once the axis reaches this value
+        int32_t releaseAt{}; //!< The key is released once the axis gets back to this value, if this is above pressAt the negative direction of the axis is used
+    };
+
+    std::array<KeyRule, KEY_CNT> keys{};
+    std::array<AxisRule, ABS_CNT> axes{};
+};
+
+//! Rewrites input events in place according to the profile of the device they came from
+class Remapper {
+  private:
+    static_assert(ABS_CNT <= 64, "Axis state must fit in a 64-bit mask");
+
+    struct DeviceState {
+        const RemapProfile &profile;
+        uint64_t axisPressed{}; //!< A bit per axis which is set while its axis->key rule is holding the key down
+    };
+
+    std::unordered_map<uint32_t, RemapProfile> mProfiles; //!< Profiles keyed by their VID/PID
+    std::unordered_map<int32_t, DeviceState> mDevices; //!< Only contains devices that have a profile
+
+  public:
+    //! Loads all device profiles from the given config file, see README.md for the format
+    void LoadProfiles(const char *path);
+
+    void AddDevice(int32_t id, int32_t vid, int32_t pid);
+
+    void RemoveDevice(int32_t id);
+
+    Response FilterEvent(HidlInputEvent &iev, int32_t deviceId);
+};
+
+} // namespace inputhook
+
+#endif // INPUTHOOK_REMAPPER_H
@@ -21,137 +21,249 @@
 #include <chrono>
 #include <cmath>
 #include <android/log.h>
+#include <cutils/properties.h>
 #include <cutils/native_handle.h>
 #include <linux/input.h>
 #include <log/log.h>
+#include <sys/ioctl.h>
+#include "Allocations.h"
 #include "InputHook.h"
 #include "DeviceDb.h"
+#include "Metrics.h"
 #include "RsMouse.h"
+#include "Tunables.h"
 
 namespace inputhook {
 namespace device {
     constexpr std::string_view Name{"Right-Stick Mouse"};
-    constexpr int16_t Bus{BUS_BLUETOOTH}; //!< Pretend to be bluetooth as not all apps will accept virtual devices
-    constexpr int16_t Pid{0}; //!< 0 PID/VID is used to identify internal devices
-    constexpr int16_t Vid{0};
-    constexpr int16_t Version{1};
+    constexpr const char *EagerProperty{"ro.vendor.inputhook.rsmouse.eager"}; //!< Creates the device at registration like older releases did, for comparing boot time and memory usage
+    constexpr const char *DirectProperty{"persist.vendor.inputhook.rsmouse.direct"}; //!< Reads the right stick from evdev rather than waiting for notifyMotionState
+    constexpr float DirectMatchTolerance{1e-3f}; //!< How close a notifyMotionState position has to be to a direct read to be considered the same frame
 }
 
-namespace cursor {
-    constexpr auto UpdateRate{std::chrono::milliseconds{1000} / 60}; //!< 60Hz update rate
-    constexpr float Deadzone{0.1f};
-    constexpr float Power{3.0f}; //!< Power for cursor velocity curve
-    constexpr float SpeedCoeffFinal{27.0f}; //! Coefficient for the final output cursor speed
-    constexpr auto FadeTime{std::chrono::seconds{5}}; //! Maximum time it takes the cursor to fade (should match frameworks/base/libs/input/PointerController.cpp)
+RsMouse::RsMouse(const DeviceDb &deviceDb, Reactor &reactor, LatencyProbe &probe, VirtualDevices &devices) : mDeviceDb(deviceDb), mReactor(reactor), mProbe(probe), mVirtualDevices(devices), mEager(property_get_bool(device::EagerProperty, false)) {}
+
+RsMouse::~RsMouse() {
+    DestroyDevice();
 }
 
-RsMouse::RsMouse(const DeviceDb &deviceDb) : mDeviceDb(deviceDb) {}
+void RsMouse::Tick() {
+    metrics::ScopedLatency latency{metrics::registry.cursorTick};
+    alloc::Scope noAllocations{alloc::Path::Tick};
+    auto now{latency.Start()};
+    auto &tunables{tunables::Current()};
+    metrics::registry.cursorTickLateness.Record(now > mTickDeadline ? now - mTickDeadline : 0);
+
+    // The timer is rearmed on every tick so that a change of the update interval applies straight away, missed ticks are skipped
+    auto interval{static_cast<uint64_t>(tunables.updateInterval.count())};
+    do {
+        mTickDeadline += interval;
+    } while (mTickDeadline <= now);
+    Reactor::ArmTimer(mTickTimer, mTickDeadline);
+
+    for (size_t i{}; i < cursor::MaxSources; i++) {
+        auto coords{mStickCoords[i].load()};
+        mSources.x[i] = coords.rsX;
+        mSources.y[i] = coords.rsY;
+    }
+    mTickCount.fetch_add(1, std::memory_order_release);
+    cursor::Update(mSources, {.deadzone = tunables.deadzone, .power = tunables.power, .speed = tunables.speed});
 
-RsMouse::~RsMouse() {
-    mExiting = true;
+    int32_t changeX{}, changeY{};
+    for (size_t i{}; i < cursor::MaxSources; i++) {
+        changeX += mSources.changeX[i];
+        changeY += mSources.changeY[i];
+    }
+    if (changeX)
+        mInjector->SendRel(REL_X, changeX);
+    if (changeY)
+        mInjector->SendRel(REL_Y, changeY);
+
+    if (changeX || changeY) {
+        if (mProbe.Active())
+            mInjector->SendMisc(MSC_SERIAL, mProbe.Tag(LatencyProbe::Path::Tick, mStickTime.load(std::memory_order_relaxed)));
+        mInjector->SendSynReport();
+        mActiveTime = std::chrono::steady_clock::now();
+        mCanClick = true;
+    }
 
-    if (mMouseThread.joinable())
-        mMouseThread.join();
+    if (mCanClick) {
+        if (std::chrono::steady_clock::now() - mActiveTime > tunables.fadeTime) {
+            mCanClick = false;
+            mSources = {}; // Take this oppertunity to reset the accumulate variable to prevent {over, under}flows, however unlikely they are
+        }
+    }
 }
 
-static float Deadzone(float value, float deadzone) {
-    if (value >= 0.0f && value < deadzone)
-        return deadzone;
+void RsMouse::CreateDevice() {
+    if (mRegistered)
+        return;
 
-    if (value < 0.0f && value > -deadzone)
-        return -deadzone;
+    mInjector = mVirtualDevices.Acquire(profile::Mouse(std::string{device::Name}));
+    if (!mInjector) {
+        ALOGE("Failed to register RsMouse");
+        return;
+    }
 
-    return value;
+    mSources = {};
+    mActiveTime = std::chrono::steady_clock::now();
+    mTickDeadline = metrics::NowNs() + static_cast<uint64_t>(tunables::Current().updateInterval.count());
+    mTickTimer = mReactor.AddTimer({}, {}, [this](uint64_t) { Tick(); });
+    Reactor::ArmTimer(mTickTimer, mTickDeadline);
+    mProbe.Attach(*mInjector);
+    mRegistered = true;
+    ALOGI("Created RsMouse device");
 }
 
-void RsMouse::MouseMain() {
-    float accumulateX{}, accumulateY{};
-    auto activeTime{std::chrono::system_clock::now()};
+void RsMouse::DestroyDevice() {
+    if (!mRegistered)
+        return;
 
-    while (!mExiting) {
-        auto coords{mStickCoords.load()};
-        float adjustedX{std::abs(Deadzone(coords.rsX, cursor::Deadzone)) - cursor::Deadzone};
-        float adjustedY{std::abs(Deadzone(coords.rsY, cursor::Deadzone)) - cursor::Deadzone};
+    mReactor.RemoveTimer(mTickTimer);
+    mTickTimer = {};
 
-        float combined{std::min(adjustedX + adjustedY, 1.0f - cursor::Deadzone)};
-        float combinedPow{std::pow(combined, cursor::Power)};
+    mProbe.Detach(*mInjector);
+    mInjector.Reset();
+    mRegistered = false;
+    mCanClick = false;
+    ClearStickCoords();
+    ALOGI("Destroyed RsMouse device");
+}
 
-        int32_t changeX{}, changeY{};
-        if (adjustedX != 0.0f) {
-            float rsX = combinedPow * adjustedX * ((coords.rsX > 0.0f) ? cursor::SpeedCoeffFinal : -cursor::SpeedCoeffFinal);
+void RsMouse::ClearStickCoords() {
+    for (auto &coords : mStickCoords)
+        coords = AnalogCoords{};
+    mClearEpoch.fetch_add(1, std::memory_order_release);
+}
 
-            changeX = static_cast<int32_t>(std::round(accumulateX + rsX)) - static_cast<int32_t>(std::round(accumulateX));
-            accumulateX += rsX;
-            if (changeX)
-                mInjector.SendRel(REL_X, changeX);
-        }
+void RsMouse::Register() {
+    if (mEnabled)
+        LOG_FATAL("Cannot register RsMouse twice!");
 
-        if (adjustedY != 0.0f) {
-            float rsY = combinedPow * adjustedY * ((coords.rsY > 0.0f) ? cursor::SpeedCoeffFinal : -cursor::SpeedCoeffFinal);
+    mEnabled = true;
 
-            changeY = static_cast<int32_t>(std::round(accumulateY + rsY)) - static_cast<int32_t>(std::round(accumulateY));
-            accumulateY += rsY;
-            if (changeY)
-                mInjector.SendRel(REL_Y, changeY);
-        }
+    // Persistent properties aren't loaded yet when the service starts at boot, so this is only read once InputFlinger is up
+    mDirect = property_get_bool(device::DirectProperty, false);
+    if (mDirect) {
+        for (auto &[id, gamepad] : mGamepads)
+            OpenReader(id, gamepad);
+    }
 
-        if (changeX || changeY) {
-            mInjector.SendSynReport();
-            activeTime = std::chrono::system_clock::now();
-            mCanClick = true;
-        }
+    if (mEager || !mGamepads.empty())
+        CreateDevice();
+}
 
-        if (mCanClick) {
-            if (std::chrono::system_clock::now() - activeTime > cursor::FadeTime) {
-                mCanClick = false;
-                accumulateX = accumulateY = 0.0f; // Take this oppertunity to reset the accumulate variable to prevent {over, under}flows, however unlikely they are
-            }
-        }
+void RsMouse::OpenReader(int32_t id, Gamepad &gamepad) {
+    if (gamepad.path.empty() || gamepad.slot >= cursor::MaxSources)
+        return;
+
+    bool z{gamepad.rightStick == RightStickAxes::ZRz};
+    gamepad.reader = StickReader::Open(mReactor, gamepad.path.c_str(), z ? ABS_Z : ABS_RX, z ? ABS_RZ : ABS_RY, [this, id, &gamepad](float x, float y, uint64_t eventTime) {
+        OnDirectFrame(id, gamepad, x, y, eventTime);
+    }, [id, &gamepad]() {
+        ALOGW("Falling back to notifyMotionState for device %d", id);
+        gamepad.direct.store(false, std::memory_order_release);
+    });
+    gamepad.direct.store(gamepad.reader != nullptr, std::memory_order_release);
+}
 
-        std::this_thread::sleep_for(cursor::UpdateRate);
-    }
+RightStickAxes RsMouse::FindRightStick(int fd) {
+    uint8_t absBits[(ABS_CNT + 7) / 8]{};
+    if (ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(absBits)), absBits) < 0)
+        return RightStickAxes::None;
+
+    auto hasAbs{[&](int code) { return (absBits[code / 8] & (1 << (code % 8))) != 0; }};
+    if (hasAbs(ABS_RX) && hasAbs(ABS_RY))
+        return RightStickAxes::RxRy;
+    if (hasAbs(ABS_Z) && hasAbs(ABS_RZ))
+        return RightStickAxes::ZRz;
+    return RightStickAxes::None;
 }
 
-void RsMouse::Register() {
-    if (mRegistered)
-        LOG_FATAL("Cannot register RsMouse twice!");
+void RsMouse::AddDevice(int32_t id, RightStickAxes rightStick, const char *path) {
+    if (auto configured{mDeviceDb.at(id).rightStick}; configured != RightStickAxes::Detect)
+        rightStick = configured;
+    if (rightStick != RightStickAxes::RxRy && rightStick != RightStickAxes::ZRz)
+        return;
+
+    auto [it, inserted]{mGamepads.try_emplace(id)};
+    if (!inserted)
+        return;
+
+    // Gamepads beyond the amount of sources still keep the device alive but can't move the cursor
+    uint8_t slot{cursor::MaxSources};
+    if (~mUsedSlots & ((1U << cursor::MaxSources) - 1)) {
+        slot = static_cast<uint8_t>(__builtin_ctz(~mUsedSlots));
+        mUsedSlots |= 1U << slot;
+    }
+    auto &gamepad{it->second};
+    gamepad.slot = slot;
+    gamepad.rightStick = rightStick;
+    gamepad.decimation = mDeviceDb.at(id).decimation;
+    if (path)
+        gamepad.path = path;
+
+    if (mDirect)
+        OpenReader(id, gamepad);
+
+    if (mEnabled)
+        CreateDevice();
+}
 
-    mInjector.ConfigureBegin(std::string{device::Name}.c_str(), device::Bus, device::Vid, device::Pid, device::Version);
-    mInjector.ConfigureInputProperty(INPUT_PROP_POINTER);
-    mInjector.ConfigureKey(BTN_LEFT);
-    mInjector.ConfigureKey(BTN_RIGHT);
-    mInjector.ConfigureRel(REL_X);
-    mInjector.ConfigureRel(REL_Y);
-    mInjector.ConfigureEnd();
+void RsMouse::RemoveDevice(int32_t id) {
+    auto gamepad{mGamepads.find(id)};
+    if (gamepad == mGamepads.end())
+        return;
 
-    auto ret{mInjector.GetError()};
-    if (ret) {
-        ALOGE("Failed to register RsMouse: %d", ret);
-    } else {
-        mMouseThread = std::thread{&RsMouse::MouseMain, this};
-        mRegistered = true;
+    if (gamepad->second.slot < cursor::MaxSources) {
+        mUsedSlots &= ~(1U << gamepad->second.slot);
+        mStickCoords[gamepad->second.slot] = AnalogCoords{};
     }
+    mGamepads.erase(gamepad);
+
+    if (!mGamepads.empty() || mEager)
+        return;
+
+    DestroyDevice();
+}
+
+void RsMouse::SetDisabled(bool disabled) {
+    mDisabled = disabled;
+    mCanClick = false;
+    ClearStickCoords();
 }
 
-Response RsMouse::FilterEvent(HidlInputEvent &iev, int32_t &deviceId) {
+Response RsMouse::FilterEvent(HidlInputEvent &iev, int32_t &deviceId, uint64_t receivedAt) {
     if (!mRegistered)
         return Response::EVENT_DEFAULT;
 
-    if (iev.type == EV_KEY && iev.code == BTN_Z && iev.value == 0) {
-        mCanClick = mDisabled;
+    auto &tunables{tunables::Current()};
+    if (iev.type == EV_KEY && iev.code == tunables.toggleKey && iev.value == 0) {
+        mCanClick = mDisabled.load();
         mDisabled = !mDisabled;
-        mStickCoords = AnalogCoords{};
+        ClearStickCoords();
         return Response::EVENT_SKIP;
     }
-    // Replace R1/R2 clicks with RsMouse clicks if possible
+    // Pads that have their right stick on ABS_Z/ABS_RZ don't have analog triggers there, so the stick mustn't click
+    if (iev.type == EV_ABS && (iev.code == ABS_Z || iev.code == ABS_RZ)) {
+        auto gamepad{mGamepads.find(deviceId)};
+        if (gamepad != mGamepads.end() && gamepad->second.rightStick == RightStickAxes::ZRz)
+            return Response::EVENT_DEFAULT;
+    }
+
+    // Replace the click triggers (R2/R1 by default) with RsMouse clicks if possible
     if (mCanClick) {
-        if (iev.type == EV_ABS && iev.code == ABS_RZ) {
-            mInjector.SendKey(BTN_LEFT, iev.value > 0);
-            mInjector.SendSynReport();
+        if (tunables.leftClick.Matches(iev.type, iev.code)) {
+            mInjector->SendKey(BTN_LEFT, iev.value > 0);
+            if (mProbe.Active())
+                mInjector->SendMisc(MSC_SERIAL, mProbe.Tag(LatencyProbe::Path::Click, receivedAt));
+            mInjector->SendSynReport();
             return Response::EVENT_SKIP;
-        } else if (iev.type == EV_KEY && iev.code == BTN_TR) {
-            mInjector.SendKey(BTN_RIGHT, iev.value);
-            mInjector.SendSynReport();
+        } else if (tunables.rightClick.Matches(iev.type, iev.code)) {
+            mInjector->SendKey(BTN_RIGHT, iev.value > 0);
+            if (mProbe.Active())
+                mInjector->SendMisc(MSC_SERIAL, mProbe.Tag(LatencyProbe::Path::Click, receivedAt));
+            mInjector->SendSynReport();
             return Response::EVENT_SKIP;
         }
     }
@@ -159,16 +271,121 @@ Response RsMouse::FilterEvent(HidlInputEvent &iev, int32_t &deviceId) {
     return Response::EVENT_DEFAULT;
 }
 
-bool RsMouse::NotifyMotionState(int32_t deviceId, const AnalogCoords &pc, bool handled) {
+void RsMouse::SubmitMotion(int32_t id, Gamepad &gamepad, const AnalogCoords &pc, uint64_t receivedAt) {
+    if (gamepad.slot >= cursor::MaxSources)
+        return;
+
+    auto epoch{mClearEpoch.load(std::memory_order_acquire)};
+    auto tick{mTickCount.load(std::memory_order_acquire)};
+    if (gamepad.clearEpoch != epoch) {
+        gamepad.clearEpoch = epoch;
+        gamepad.windowTick = tick;
+        gamepad.samples = 0;
+        gamepad.published = AnalogCoords{};
+    } else if (gamepad.windowTick != tick) {
+        gamepad.windowTick = tick;
+        gamepad.samples = 0;
+    } else if (gamepad.samples) {
+        metrics::registry.CountCoalesced(id);
+    }
+
+    auto coords{pc};
+    switch (gamepad.decimation) {
+        case MotionDecimation::Latest:
+            break;
+        case MotionDecimation::Peak: {
+            float deflection{std::abs(pc.rsX) + std::abs(pc.rsY)};
+            if (gamepad.samples && deflection < gamepad.peak)
+                coords = gamepad.published;
+            else
+                gamepad.peak = deflection;
+            break;
+        }
+        case MotionDecimation::Mean:
+            if (!gamepad.samples)
+                gamepad.sumX = gamepad.sumY = 0.0f;
+            gamepad.sumX += pc.rsX;
+            gamepad.sumY += pc.rsY;
+            coords.rsX = gamepad.sumX / static_cast<float>(gamepad.samples + 1);
+            coords.rsY = gamepad.sumY / static_cast<float>(gamepad.samples + 1);
+            break;
+    }
+    gamepad.samples++;
+
+    // Samples that don't change what the next tick would see are answered without touching the shared state
+    if (coords.rsX != gamepad.published.rsX || coords.rsY != gamepad.published.rsY) {
+        gamepad.published = coords;
+        mStickCoords[gamepad.slot] = coords;
+        mStickTime.store(receivedAt, std::memory_order_relaxed);
+    }
+}
+
+void RsMouse::OnDirectFrame(int32_t id, Gamepad &gamepad, float x, float y, uint64_t eventTime) {
+    auto now{metrics::NowNs()};
+    metrics::registry.directReadDelay.Record(now > eventTime ? now - eventTime : 0);
+
+    // The reactor is the only writer, a reader that overlaps with this sees |sequence| change and skips the frame
+    auto number{mDirectFrameCount.load(std::memory_order_relaxed) + 1};
+    auto &frame{mDirectFrames[(number - 1) % mDirectFrames.size()]};
+    frame.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    frame.id.store(id, std::memory_order_relaxed);
+    frame.x.store(x, std::memory_order_relaxed);
+    frame.y.store(y, std::memory_order_relaxed);
+    frame.readAt.store(now, std::memory_order_relaxed);
+    frame.sequence.store(number, std::memory_order_release);
+    mDirectFrameCount.store(number, std::memory_order_release);
+
+    if (!mRegistered || mDisabled || gamepad.appHandlesMotion.load(std::memory_order_relaxed))
+        return;
+
+    AnalogCoords coords{};
+    coords.rsX = x;
+    coords.rsY = y;
+    SubmitMotion(id, gamepad, coords, now);
+}
+
+void RsMouse::RecordDirectLead(int32_t id, Gamepad &gamepad, const AnalogCoords &pc, uint64_t receivedAt) {
+    // Search from the newest frame back to the last one this gamepad matched
+    auto newest{mDirectFrameCount.load(std::memory_order_acquire)};
+    for (auto number{newest}; number > gamepad.matchedFrame && newest - number < mDirectFrames.size(); number--) {
+        auto &frame{mDirectFrames[(number - 1) % mDirectFrames.size()]};
+        if (frame.sequence.load(std::memory_order_acquire) != number)
+            continue;
+
+        auto frameId{frame.id.load(std::memory_order_relaxed)};
+        auto x{frame.x.load(std::memory_order_relaxed)};
+        auto y{frame.y.load(std::memory_order_relaxed)};
+        auto readAt{frame.readAt.load(std::memory_order_relaxed)};
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (frame.sequence.load(std::memory_order_relaxed) != number)
+            continue; // The reactor reused the entry while it was being read
+
+        if (frameId == id && readAt <= receivedAt && std::abs(x - pc.rsX) < device::DirectMatchTolerance && std::abs(y - pc.rsY) < device::DirectMatchTolerance) {
+            metrics::registry.directLead.Record(receivedAt - readAt);
+            gamepad.matchedFrame = number;
+            return;
+        }
+    }
+}
+
+bool RsMouse::NotifyMotionState(int32_t deviceId, const AnalogCoords &pc, bool handled, uint64_t receivedAt) {
     if (!mRegistered)
         return false;
 
+    auto it{mGamepads.find(deviceId)};
+    auto gamepad{it != mGamepads.end() ? &it->second : nullptr};
+    bool direct{gamepad && gamepad->direct.load(std::memory_order_acquire)};
+    if (direct) {
+        gamepad->appHandlesMotion.store(handled, std::memory_order_relaxed);
+        RecordDirectLead(deviceId, *gamepad, pc, receivedAt);
+    }
+
     // If the app handles any motion event then we stop grabbing click inputs
     if (handled || mDisabled)
         mCanClick = false;
-    else
-        mStickCoords = pc;
-
+    else if (gamepad && !direct)
+        SubmitMotion(deviceId, *gamepad, pc, receivedAt);
 
     return true;
 }
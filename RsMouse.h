@@ -18,41 +18,134 @@
 #define INPUTHOOK_RSMOUSE_H
 
 #include <atomic>
-#include <thread>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <array>
+#include <unordered_map>
+#include "CursorKernel.h"
+#include "DeviceDb.h"
 #include "EvdevInjector.h"
+#include "LatencyProbe.h"
+#include "Reactor.h"
+#include "StickReader.h"
+#include "VirtualDevices.h"
 #include "Common.h"
 
 namespace inputhook {
 
-class DeviceDb;
-
 class RsMouse {
   private:
-    // RsMouse thread stuff
-    std::atomic<AnalogCoords> mStickCoords{};
-    std::atomic_bool mExiting{}; //!< If the RsMouse thread should exit
+    // RsMouse tick stuff, ticks run on the reactor thread
+    std::array<std::atomic<AnalogCoords>, cursor::MaxSources> mStickCoords{}; //!< Indexed by the source slot of each gamepad
+    std::atomic<uint64_t> mStickTime{}; //!< When |mStickCoords| was last received, for the latency probe
     std::atomic_bool mCanClick{}; //!< Controls whether R3 press events will be treated as mouse clicks or passed through
-    bool mDisabled{};
-    std::thread mMouseThread;
+    std::atomic_bool mDisabled{};
+    cursor::Sources mSources{}; //!< Only accessed by ticks
+    std::chrono::steady_clock::time_point mActiveTime; //!< The last time the cursor moved
+    uint64_t mTickDeadline{}; //!< When the next tick is due, for measuring lateness
+    Reactor::Timer mTickTimer;
 
     const DeviceDb &mDeviceDb;
-    EvdevInjector mInjector;
+    Reactor &mReactor;
+    LatencyProbe &mProbe;
+    VirtualDevices &mVirtualDevices;
+    VirtualDevices::Lease mInjector; //!< Only held while the RsMouse input device is needed
+
+    bool mEnabled{}; //!< If InputFlinger has asked for our devices to be registered
+    bool mEager{}; //!< If the input device should be created upfront rather than when the first gamepad appears
+    bool mDirect{}; //!< If gamepads should have their right stick read straight from evdev, only known once registered
+    std::atomic_bool mRegistered{}; //!< If the RsMouse input device  has been registered
+    struct Gamepad {
+        uint8_t slot{}; //!< The cursor source slot or MaxSources if there wasn't one free
+        RightStickAxes rightStick{};
+        MotionDecimation decimation{};
+        std::atomic_bool direct{}; //!< If the stick is read by |reader| rather than taken from notifyMotionState
+        std::atomic_bool appHandlesMotion{}; //!< The last |handled| from notifyMotionState, which direct reads can't know upfront
+        std::string path; //!< The evdev node for direct reads, empty if it isn't known
+        uint64_t matchedFrame{}; //!< The newest direct frame notifyMotionState matched, only accessed by it so every frame is matched once
+
+        // Combines the samples received since the last tick, only accessed by whichever of the two paths above is in use
+        uint64_t windowTick{}; //!< The value of |mTickCount| when the window started
+        uint32_t samples{};
+        float sumX{}, sumY{}; //!< For MotionDecimation::Mean
+        float peak{}; //!< The deflection of the published sample for MotionDecimation::Peak
+        AnalogCoords published{}; //!< The coordinates last stored into |mStickCoords|
+        uint32_t clearEpoch{}; //!< The value of |mClearEpoch| that |published| belongs to
+
+        std::unique_ptr<StickReader> reader; //!< Last so it's destroyed, and its callbacks stopped, before anything they use
+    };
+
+    /**
+     * @brief A stick position seen by a direct read, kept to measure how far ahead of notifyMotionState it was
+     * @note Frames are written by the reactor and read by notifyMotionState without a lock, |sequence| makes the reader discard a frame that's overwritten under it
+     */
+    struct DirectFrame {
+        std::atomic<uint64_t> sequence{}; //!< The frame number once it's complete, 0 while it's written
+        std::atomic<int32_t> id{-1};
+        std::atomic<float> x{}, y{};
+        std::atomic<uint64_t> readAt{};
+    };
 
-    bool mRegistered{}; //!< If the RsMouse input device  has been registered
+    std::atomic<uint64_t> mTickCount{}; //!< Incremented after every tick has read |mStickCoords|
+    std::atomic<uint32_t> mClearEpoch{}; //!< Incremented whenever |mStickCoords| is cleared, so both paths drop their windows
+    std::array<DirectFrame, 16> mDirectFrames{}; //!< Frame n is in index (n - 1) % size
+    std::atomic<uint64_t> mDirectFrameCount{}; //!< The number of the newest frame, only written by the reactor
+    std::unordered_map<int32_t, Gamepad> mGamepads; //!< Devices with a right stick that RsMouse can be driven by
+    uint32_t mUsedSlots{}; //!< A bitmask of the source slots in use
     int32_t rightStickButtonState{}; //!< Keeps track of whether the right stick button has been pressed
 
-    void MouseMain();
+    void Tick();
+
+    void CreateDevice();
+
+    void DestroyDevice();
+
+    void ClearStickCoords();
+
+    //! Applies the gamepad's decimation policy to a motion sample and publishes the result for the next tick
+    void SubmitMotion(int32_t id, Gamepad &gamepad, const AnalogCoords &coords, uint64_t receivedAt);
+
+    //! Starts reading the gamepad's right stick straight from its evdev node if it has a known node and a source slot
+    void OpenReader(int32_t id, Gamepad &gamepad);
+
+    void OnDirectFrame(int32_t id, Gamepad &gamepad, float x, float y, uint64_t eventTime);
+
+    void RecordDirectLead(int32_t id, Gamepad &gamepad, const AnalogCoords &pc, uint64_t receivedAt);
 
   public:
-    explicit RsMouse(const DeviceDb &deviceDb);
+    RsMouse(const DeviceDb &deviceDb, Reactor &reactor, LatencyProbe &probe, VirtualDevices &devices);
 
     ~RsMouse();
 
+    //! Enables RsMouse, the input device is only created once a gamepad with a right stick is connected
     void Register();
 
-    Response FilterEvent(HidlInputEvent &iev, int32_t &deviceId);
+    /**
+     * @return The axes the device behind the evdev fd has a right stick on, ABS_RX/ABS_RY are preferred as pads with both use ABS_Z/ABS_RZ for the triggers
+     * @note This matches InputFlinger's default key layout, which maps both pairs to the right stick
+     */
+    static RightStickAxes FindRightStick(int fd);
+
+    /**
+     * @param rightStick The detected right stick axes, the device's DeviceDb entry takes precedence
+     * @param path The evdev node of the device for direct reads, or nullptr if it isn't known
+     */
+    void AddDevice(int32_t id, RightStickAxes rightStick, const char *path);
+
+    void RemoveDevice(int32_t id);
+
+    //! If RsMouse has been toggled off with the toggle key
+    bool Disabled() const {
+        return mDisabled.load();
+    }
+
+    void SetDisabled(bool disabled);
+
+    //! @param receivedAt The CLOCK_MONOTONIC time in nanoseconds at which the hook received the event
+    Response FilterEvent(HidlInputEvent &iev, int32_t &deviceId, uint64_t receivedAt);
 
-    bool NotifyMotionState(int32_t deviceId, const AnalogCoords &pc, bool handled);
+    bool NotifyMotionState(int32_t deviceId, const AnalogCoords &pc, bool handled, uint64_t receivedAt);
 };
 
 } // namespace inputhook
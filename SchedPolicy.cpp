@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SchedPolicy"
+
+// #define LOG_NDEBUG 0
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <android/log.h>
+#include <cutils/properties.h>
+#include <log/log.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "SchedPolicy.h"
+
+namespace inputhook {
+
+SchedPolicy SchedPolicy::FromProperties() {
+    SchedPolicy policy{};
+
+    char value[PROPERTY_VALUE_MAX]{};
+    property_get("persist.vendor.inputhook.sched.policy", value, "");
+    if (!strcmp(value, "fifo")) {
+        policy.kind = Kind::Fifo;
+        policy.priority = property_get_int32("persist.vendor.inputhook.sched.priority", 2);
+    } else if (!strcmp(value, "nice")) {
+        policy.kind = Kind::Nice;
+        policy.priority = property_get_int32("persist.vendor.inputhook.sched.priority", FallbackNice);
+    }
+
+    property_get("persist.vendor.inputhook.sched.affinity", value, "0");
+    policy.affinity = strtoull(value, nullptr, 16);
+    policy.lockMemory = property_get_bool("persist.vendor.inputhook.sched.mlock", false);
+
+    return policy;
+}
+
+SchedPolicy SchedPolicy::Apply() const {
+    SchedPolicy applied{*this};
+
+    if (applied.kind == Kind::Fifo) {
+        sched_param param{.sched_priority = applied.priority};
+        if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param)) {
+            ALOGW("SCHED_FIFO at %d was denied (%d), falling back to nice %d", applied.priority, errno, FallbackNice);
+            applied.kind = Kind::Nice;
+            applied.priority = FallbackNice;
+        }
+    }
+
+    // Linux applies niceness per-thread when given a TID
+    if (applied.kind == Kind::Nice && setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), applied.priority)) {
+        ALOGW("Nice %d was denied (%d), leaving the default priority", applied.priority, errno);
+        applied.kind = Kind::Default;
+        applied.priority = 0;
+    }
+
+    if (applied.affinity) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu{}; cpu < 64 && cpu < CPU_SETSIZE; cpu++)
+            if (applied.affinity & (1ULL << cpu))
+                CPU_SET(cpu, &set);
+
+        if (sched_setaffinity(0, sizeof(set), &set)) {
+            ALOGW("CPU affinity 0x%llx was denied (%d)", static_cast<unsigned long long>(applied.affinity), errno);
+            applied.affinity = 0;
+        }
+    }
+
+    if (applied.lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE)) {
+        ALOGW("Locking memory was denied (%d)", errno);
+        applied.lockMemory = false;
+    }
+
+    ALOGI("Applied scheduling policy: %s %d, affinity 0x%llx, memory %slocked", applied.KindName(), applied.priority,
+          static_cast<unsigned long long>(applied.affinity), applied.lockMemory ? "" : "not ");
+
+    return applied;
+}
+
+const char *SchedPolicy::KindName() const {
+    switch (kind) {
+        case Kind::Default:
+            return "default";
+        case Kind::Nice:
+            return "nice";
+        case Kind::Fifo:
+            return "fifo";
+    }
+    return "unknown";
+}
+
+} // namespace inputhook
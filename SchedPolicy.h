@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_SCHED_POLICY_H
+#define INPUTHOOK_SCHED_POLICY_H
+
+#include <cstdint>
+
+namespace inputhook {
+
+/**
+ * @brief Scheduling settings for a latency sensitive thread
+ */
+struct SchedPolicy {
+    enum class Kind : uint8_t {
+        Default, //!< Leave the thread as SCHED_OTHER at the default niceness
+        Nice, //!< SCHED_OTHER with |priority| as the niceness
+        Fifo, //!< SCHED_FIFO at |priority|, falls back to Nice with FallbackNice if this isn't permitted
+    } kind{Kind::Default};
+
+    static constexpr int FallbackNice{-10};
+
+    int priority{};
+    uint64_t affinity{}; //!< A mask of the CPUs the thread may run on, 0 leaves it unrestricted
+    bool lockMemory{}; //!< Locks all current and future process memory to avoid page fault stalls
+
+    /**
+     * @brief Reads the policy from the persist.vendor.inputhook.sched.* properties, see README.md
+     * @note Persistent properties are only loaded once /data is mounted, at early boot this returns the defaults
+     */
+    static SchedPolicy FromProperties();
+
+    /**
+     * @brief Applies the policy to the calling thread, any part that's denied is logged and skipped
+     * @return The policy that ended up being applied
+     */
+    SchedPolicy Apply() const;
+
+    const char *KindName() const;
+
+    bool operator==(const SchedPolicy &other) const {
+        return kind == other.kind && priority == other.priority && affinity == other.affinity && lockMemory == other.lockMemory;
+    }
+
+    bool operator!=(const SchedPolicy &other) const {
+        return !(*this == other);
+    }
+};
+
+} // namespace inputhook
+
+#endif // INPUTHOOK_SCHED_POLICY_H
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "StateSnapshot"
+
+// #define LOG_NDEBUG 0
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <android-base/unique_fd.h>
+#include <android/log.h>
+#include <cutils/properties.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "StateSnapshot.h"
+
+namespace inputhook {
+
+namespace snapshot {
+    constexpr const char *Path{"/dev/inputhook/state"}; //!< On tmpfs, so a reboot always starts from scratch
+    constexpr const char *EnabledProperty{"persist.vendor.inputhook.snapshot"};
+    constexpr uint32_t Magic{0x53484b49}; // "IKHS"
+    constexpr uint32_t Version{1}; //!< Must be bumped whenever State changes
+}
+
+StateSnapshot::~StateSnapshot() {
+    if (mFile)
+        munmap(mFile, sizeof(File));
+}
+
+std::optional<StateSnapshot::State> StateSnapshot::Open() {
+    android::base::unique_fd fd{open(snapshot::Path, O_RDWR | O_CREAT | O_CLOEXEC, 0660)};
+    struct stat info{};
+    if (fd.get() < 0 || fstat(fd.get(), &info)) {
+        mError = errno;
+        ALOGW("Failed to open %s, warm restarts are disabled: %d", snapshot::Path, mError);
+        return std::nullopt;
+    }
+
+    bool fresh{info.st_size != static_cast<off_t>(sizeof(File))};
+    if (fresh && ftruncate(fd.get(), sizeof(File))) {
+        mError = errno;
+        ALOGW("Failed to size %s, warm restarts are disabled: %d", snapshot::Path, mError);
+        return std::nullopt;
+    }
+
+    void *map{mmap(nullptr, sizeof(File), PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0)};
+    if (map == MAP_FAILED) {
+        mError = errno;
+        ALOGW("Failed to map %s, warm restarts are disabled: %d", snapshot::Path, mError);
+        return std::nullopt;
+    }
+    mFile = static_cast<File *>(map);
+
+    std::optional<State> previous;
+    if (!fresh && mFile->magic == snapshot::Magic && mFile->version == snapshot::Version) {
+        auto &state{mFile->states[mFile->active.load(std::memory_order_acquire) & 1]};
+        // Only a restart has a previous state, and unlike at boot the persistent properties are normally loaded by then
+        if (!property_get_bool(snapshot::EnabledProperty, true))
+            ALOGI("Not restoring the previous state, warm restarts are disabled");
+        else if (state.deviceCount <= MaxDevices)
+            previous = state;
+    }
+
+    // Start out empty and let the restored state be recorded again as it's re-applied, a crash while restoring then can't turn into a crash loop
+    mFile->magic = snapshot::Magic;
+    mFile->version = snapshot::Version;
+    mState = {};
+    Commit();
+    return previous;
+}
+
+void StateSnapshot::Commit() {
+    if (!mFile)
+        return;
+
+    auto next{(mFile->active.load(std::memory_order_relaxed) + 1) & 1};
+    mFile->states[next] = mState;
+    mFile->active.store(next, std::memory_order_release);
+}
+
+void StateSnapshot::AddDevice(int32_t id, int32_t vendor, int32_t product, const char *path) {
+    if (!path || strlen(path) >= MaxPath)
+        return;
+
+    Device *device{};
+    for (uint32_t i{}; i < mState.deviceCount; i++) {
+        if (mState.devices[i].id == id)
+            device = &mState.devices[i];
+    }
+    if (!device) {
+        if (mState.deviceCount == MaxDevices) {
+            ALOGW("Not recording device %d, the snapshot is full", id);
+            return;
+        }
+        device = &mState.devices[mState.deviceCount++];
+    }
+
+    *device = Device{.id = id, .vendor = vendor, .product = product};
+    strncpy(device->path, path, MaxPath - 1);
+    Commit();
+}
+
+void StateSnapshot::RemoveDevice(int32_t id) {
+    for (uint32_t i{}; i < mState.deviceCount; i++) {
+        if (mState.devices[i].id == id) {
+            mState.devices[i] = mState.devices[--mState.deviceCount];
+            Commit();
+            return;
+        }
+    }
+}
+
+std::optional<int32_t> StateSnapshot::FindByPath(const char *path) const {
+    for (uint32_t i{}; i < mState.deviceCount; i++) {
+        if (!strcmp(mState.devices[i].path, path))
+            return mState.devices[i].id;
+    }
+    return std::nullopt;
+}
+
+void StateSnapshot::SetRegistered() {
+    mState.registered = true;
+    Commit();
+}
+
+void StateSnapshot::SetRsMouseDisabled(bool disabled) {
+    mState.rsMouseDisabled = disabled;
+    Commit();
+}
+
+void StateSnapshot::Dump(int fd) const {
+    if (!mFile) {
+        dprintf(fd, "State snapshot: unavailable (%s)\n", mError ? strerror(mError) : "not opened");
+        return;
+    }
+
+    dprintf(fd, "State snapshot: %s, %u devices, %s, RsMouse %s\n", snapshot::Path, mState.deviceCount, mState.registered ? "registered" : "not registered",
+            mState.rsMouseDisabled ? "disabled" : "enabled");
+    for (uint32_t i{}; i < mState.deviceCount; i++) {
+        auto &device{mState.devices[i]};
+        dprintf(fd, "  %4d: %04x:%04x %s\n", device.id, device.vendor, device.product, device.path);
+    }
+}
+
+} // namespace inputhook
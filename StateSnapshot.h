@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_STATE_SNAPSHOT_H
+#define INPUTHOOK_STATE_SNAPSHOT_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace inputhook {
+
+/**
+ * @brief The state a restarted service needs to carry on where the previous instance left off, kept in a tmpfs file that survives service restarts but not reboots
+ * @note The file is mapped and double-buffered, so an update is a copy into the spare buffer and a flip, and a crash halfway through one leaves the previous state intact
+ */
+class StateSnapshot {
+  public:
+    static constexpr size_t MaxDevices{32};
+    static constexpr size_t MaxPath{64};
+
+    struct Device {
+        int32_t id;
+        int32_t vendor;
+        int32_t product;
+        char path[MaxPath]; //!< The evdev node, used to check that the device is still the same one after a restart
+    };
+
+    struct State {
+        uint32_t deviceCount;
+        std::array<Device, MaxDevices> devices;
+        bool registered; //!< If InputFlinger has called registerDevices
+        bool rsMouseDisabled;
+    };
+
+  private:
+    struct File {
+        uint32_t magic;
+        uint32_t version;
+        std::atomic<uint32_t> active; //!< The index of the buffer holding the current state
+        State states[2];
+    };
+
+    File *mFile{};
+    int mError{}; //!< The errno that kept the file from being mapped, usually EACCES without the SELinux policy from README.md
+    State mState{}; //!< The state as of the last commit, this is only touched from the HIDL thread
+
+    //! Publishes |mState| to the file
+    void Commit();
+
+  public:
+    StateSnapshot() = default;
+
+    ~StateSnapshot();
+
+    StateSnapshot(const StateSnapshot &) = delete;
+
+    StateSnapshot &operator=(const StateSnapshot &) = delete;
+
+    /**
+     * @brief Maps the snapshot file, the state is always recorded but persist.vendor.inputhook.snapshot=false skips restoring it so cold starts can be compared
+     * @return The state left by the previous instance, if there was one and restoring is enabled
+     */
+    std::optional<State> Open();
+
+    //! Devices without an evdev node (replays, soaks) and ones that don't fit aren't recorded
+    void AddDevice(int32_t id, int32_t vendor, int32_t product, const char *path);
+
+    void RemoveDevice(int32_t id);
+
+    //! @return The ID a device with the given evdev node was recorded with
+    std::optional<int32_t> FindByPath(const char *path) const;
+
+    void SetRegistered();
+
+    bool RsMouseDisabled() const {
+        return mState.rsMouseDisabled;
+    }
+
+    void SetRsMouseDisabled(bool disabled);
+
+    void Dump(int fd) const;
+};
+
+} // namespace inputhook
+
+#endif // INPUTHOOK_STATE_SNAPSHOT_H
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "StickReader"
+
+// #define LOG_NDEBUG 0
+
+#include <algorithm>
+#include <cmath>
+#include <android/log.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <log/log.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "StickReader.h"
+
+namespace inputhook {
+
+constexpr size_t ReadBatch{64}; //!< Events read per syscall, a stick frame is at most a handful
+
+float StickReader::Axis::Normalise() const {
+    float normalised{static_cast<float>(value) * scale + offset};
+    if (std::abs(normalised) <= flat)
+        return 0.0f;
+    return std::clamp(normalised, -1.0f, 1.0f);
+}
+
+StickReader::StickReader(Reactor &reactor, android::base::unique_fd fd, uint16_t xCode, uint16_t yCode, Callback callback, ErrorCallback errorCallback)
+    : mReactor(reactor), mFd(std::move(fd)), mCallback(std::move(callback)), mErrorCallback(std::move(errorCallback)), mXCode(xCode), mYCode(yCode) {}
+
+StickReader::~StickReader() {
+    mReactor.RemoveFd(mHandle);
+}
+
+bool StickReader::ReadAxis(uint16_t code, Axis &axis) {
+    input_absinfo info{};
+    if (ioctl(mFd.get(), EVIOCGABS(code), &info) < 0 || info.maximum <= info.minimum)
+        return false;
+
+    axis.scale = 2.0f / static_cast<float>(info.maximum - info.minimum);
+    axis.offset = -(static_cast<float>(info.minimum + info.maximum) / 2.0f) * axis.scale;
+    axis.flat = static_cast<float>(info.flat) * axis.scale;
+    axis.value = info.value;
+    return true;
+}
+
+std::unique_ptr<StickReader> StickReader::Open(Reactor &reactor, const char *path, uint16_t xCode, uint16_t yCode, Callback callback, ErrorCallback errorCallback) {
+    android::base::unique_fd fd{open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC)};
+    if (fd.get() < 0) {
+        ALOGW("Failed to open %s: %d", path, errno);
+        return nullptr;
+    }
+
+    // Frames are stamped on the same clock as everything else we measure
+    int clock{CLOCK_MONOTONIC};
+    ioctl(fd.get(), EVIOCSCLOCKID, &clock);
+
+    std::unique_ptr<StickReader> reader{new StickReader(reactor, std::move(fd), xCode, yCode, std::move(callback), std::move(errorCallback))};
+    if (!reader->ReadAxis(xCode, reader->mX) || !reader->ReadAxis(yCode, reader->mY)) {
+        ALOGW("No usable right stick range on %s", path);
+        return nullptr;
+    }
+
+    reader->mHandle = reactor.AddFd(reader->mFd.get(), EPOLLIN, [reader{reader.get()}](uint32_t) { reader->OnReadable(); });
+    if (!reader->mHandle)
+        return nullptr;
+
+    return reader;
+}
+
+void StickReader::Fail() {
+    mFailed = true;
+    // The handler can't be removed from inside itself, the destructor's removal queues behind this so |this| is still valid
+    mReactor.Post([this]() { mReactor.RemoveFd(mHandle); });
+    mErrorCallback();
+}
+
+void StickReader::OnReadable() {
+    if (mFailed)
+        return;
+
+    input_event events[ReadBatch];
+    ssize_t length;
+    while ((length = read(mFd.get(), events, sizeof(events))) > 0) {
+        for (size_t i{}, count{static_cast<size_t>(length) / sizeof(input_event)}; i < count; i++) {
+            auto &event{events[i]};
+            if (event.type == EV_ABS && !mDropped) {
+                if (event.code == mXCode) {
+                    mX.value = event.value;
+                    mChanged = true;
+                } else if (event.code == mYCode) {
+                    mY.value = event.value;
+                    mChanged = true;
+                }
+            } else if (event.type == EV_SYN && event.code == SYN_DROPPED) {
+                mDropped = true;
+            } else if (event.type == EV_SYN && event.code == SYN_REPORT) {
+                if (mDropped) {
+                    mDropped = false;
+                    mChanged = ReadAxis(mXCode, mX) && ReadAxis(mYCode, mY);
+                }
+
+                if (mChanged) {
+                    mChanged = false;
+                    auto eventTime{static_cast<uint64_t>(event.input_event_sec) * 1000000000 + static_cast<uint64_t>(event.input_event_usec) * 1000};
+                    mCallback(mX.Normalise(), mY.Normalise(), eventTime);
+                }
+            }
+        }
+    }
+
+    if (length == 0 || (length < 0 && errno != EAGAIN && errno != EINTR)) {
+        ALOGW("Stopped reading the right stick directly: %d", length < 0 ? errno : 0);
+        Fail();
+    }
+}
+
+} // namespace inputhook
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_STICK_READER_H
+#define INPUTHOOK_STICK_READER_H
+
+#include <android-base/unique_fd.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "Reactor.h"
+
+namespace inputhook {
+
+/**
+ * @brief Reads the right stick of a gamepad straight from its evdev node on the reactor, ahead of InputFlinger's dispatch
+ * @note The node is opened again rather than using the fd InputFlinger hands us, as a dup shares its event queue and would steal events from it
+ */
+class StickReader {
+  public:
+    //! Called on the reactor thread with the normalised stick position of every complete frame
+    //! @param eventTime The CLOCK_MONOTONIC time in nanoseconds the kernel stamped the frame with
+    using Callback = std::function<void(float x, float y, uint64_t eventTime)>;
+
+    //! Called on the reactor thread once if the device stops being readable, no more frames are delivered after it
+    using ErrorCallback = std::function<void()>;
+
+  private:
+    //! Maps raw values to [-1, 1] the same way InputFlinger does for joystick axes, including its flat region around the centre
+    struct Axis {
+        float scale;
+        float offset;
+        float flat; //!< In normalised units, positions this close to the centre read as 0
+        int32_t value;
+
+        float Normalise() const;
+    };
+
+    Reactor &mReactor;
+    android::base::unique_fd mFd;
+    Reactor::Handle mHandle{};
+    Callback mCallback;
+    ErrorCallback mErrorCallback;
+    uint16_t mXCode, mYCode; //!< The axes of the stick
+    Axis mX{}, mY{};
+    bool mChanged{}; //!< If either axis changed since the last frame
+    bool mDropped{}; //!< If the kernel dropped events, the axes are resynced at the next SYN_REPORT
+    bool mFailed{};
+
+    StickReader(Reactor &reactor, android::base::unique_fd fd, uint16_t xCode, uint16_t yCode, Callback callback, ErrorCallback errorCallback);
+
+    //! @return If the current value and range of the axis could be read
+    bool ReadAxis(uint16_t code, Axis &axis);
+
+    void OnReadable();
+
+    void Fail();
+
+  public:
+    ~StickReader();
+
+    //! @return A reader for the stick on the |xCode| and |yCode| axes of the device at |path| or nullptr if it can't be opened or doesn't have those axes
+    static std::unique_ptr<StickReader> Open(Reactor &reactor, const char *path, uint16_t xCode, uint16_t yCode, Callback callback, ErrorCallback errorCallback);
+};
+
+} // namespace inputhook
+
+#endif // INPUTHOOK_STICK_READER_H
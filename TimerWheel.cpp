@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include "TimerWheel.h"
+
+namespace inputhook {
+
+TimerWheel::TimerWheel(uint64_t now) : mNow(now) {
+    for (auto &level : mSlots) {
+        for (auto &sentinel : level) {
+            sentinel.prev = &sentinel;
+            sentinel.next = &sentinel;
+        }
+    }
+}
+
+void TimerWheel::Insert(Timer &timer) {
+    uint64_t delta{timer.expiry > mNow ? timer.expiry - mNow : 0};
+
+    // Find the lowest level that can represent the delay, the slot within it is picked from the absolute expiry so it's only reached once the lower levels have wrapped around
+    int level{};
+    while (level < Levels - 1 && delta >= (1ULL << (SlotBits * (level + 1))))
+        level++;
+
+    size_t slot{static_cast<size_t>((timer.expiry >> (SlotBits * level)) & SlotMask)};
+    auto &sentinel{mSlots[level][slot]};
+    timer.prev = sentinel.prev;
+    timer.next = &sentinel;
+    sentinel.prev->next = &timer;
+    sentinel.prev = &timer;
+    timer.level = static_cast<uint8_t>(level);
+    timer.slot = static_cast<uint8_t>(slot);
+    mOccupied[level] |= 1ULL << slot;
+}
+
+void TimerWheel::Unlink(Timer &timer) {
+    timer.prev->next = timer.next;
+    timer.next->prev = timer.prev;
+    timer.prev = timer.next = nullptr;
+
+    auto &sentinel{mSlots[timer.level][timer.slot]};
+    if (sentinel.next == &sentinel)
+        mOccupied[timer.level] &= ~(1ULL << timer.slot);
+}
+
+void TimerWheel::Schedule(Timer &timer, uint64_t delay) {
+    if (timer.Pending())
+        Unlink(timer);
+
+    timer.expiry = mNow + std::clamp<uint64_t>(delay, 1, MaxDelay);
+    Insert(timer);
+}
+
+void TimerWheel::Cancel(Timer &timer) {
+    if (timer.Pending())
+        Unlink(timer);
+}
+
+void TimerWheel::Cascade(int level, size_t slot) {
+    auto &sentinel{mSlots[level][slot]};
+    while (sentinel.next != &sentinel) {
+        auto &timer{static_cast<Timer &>(*sentinel.next)};
+        Unlink(timer);
+        Insert(timer);
+    }
+}
+
+void TimerWheel::Advance(uint64_t now) {
+    while (mNow < now) {
+        // Skip over ticks that have nothing to fire or cascade
+        auto wakeup{NextWakeup()};
+        if (!wakeup || *wakeup > now) {
+            mNow = now;
+            break;
+        }
+
+        mNow = *wakeup;
+
+        if ((mNow & SlotMask) == 0) {
+            // Higher levels must be cascaded first as their timers may land in the lower ones that are cascaded after
+            int level{1};
+            while (level < Levels - 1 && ((mNow >> (SlotBits * level)) & SlotMask) == 0)
+                level++;
+
+            for (; level > 0; level--)
+                Cascade(level, static_cast<size_t>((mNow >> (SlotBits * level)) & SlotMask));
+        }
+
+        auto &sentinel{mSlots[0][mNow & SlotMask]};
+        while (sentinel.next != &sentinel) {
+            auto &timer{static_cast<Timer &>(*sentinel.next)};
+            Unlink(timer);
+            timer.callback(); // This may reschedule the timer or schedule new ones into this slot, those are handled by the loop
+        }
+    }
+}
+
+std::optional<uint64_t> TimerWheel::NextWakeup() const {
+    std::optional<uint64_t> wakeup;
+
+    for (int level{}; level < Levels; level++) {
+        if (!mOccupied[level])
+            continue;
+
+        // A level's slots are visited every 1 << (SlotBits * level) ticks, rotate the mask so the bit for the next visit is first
+        int shift{SlotBits * level};
+        uint64_t next{(mNow >> shift) + 1};
+        size_t first{static_cast<size_t>(next & SlotMask)};
+        uint64_t rotated{(mOccupied[level] >> first) | (first ? mOccupied[level] << (SlotCount - first) : 0)};
+        uint64_t visit{(next + static_cast<uint64_t>(__builtin_ctzll(rotated))) << shift};
+        wakeup = wakeup ? std::min(*wakeup, visit) : visit;
+    }
+
+    return wakeup;
+}
+
+} // namespace inputhook
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_TIMER_WHEEL_H
+#define INPUTHOOK_TIMER_WHEEL_H
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+
+namespace inputhook {
+
+/**
+ * @brief A hierarchical timing wheel with O(1) scheduling and cancellation, time is measured in abstract ticks
+ * @note This isn't thread-safe, the owner must serialise all calls including the ones made from timer callbacks
+ */
+class TimerWheel {
+  public:
+    static constexpr int SlotBits{6};
+    static constexpr int Levels{4};
+    static constexpr uint64_t MaxDelay{(1ULL << (SlotBits * Levels)) - 1}; //!< Longer delays are clamped to this
+
+    struct Link {
+        Link *prev{};
+        Link *next{};
+    };
+
+    /**
+     * @brief An intrusive timer, the owner must keep it alive while it's pending
+     */
+    class Timer : private Link {
+      private:
+        friend class TimerWheel;
+
+        uint64_t expiry{};
+        uint8_t level{};
+        uint8_t slot{};
+
+      public:
+        std::function<void()> callback; //!< Set this up once before the first use so scheduling never allocates
+
+        Timer() = default;
+
+        explicit Timer(std::function<void()> callback) : callback(std::move(callback)) {}
+
+        Timer(const Timer &) = delete;
+
+        Timer &operator=(const Timer &) = delete;
+
+        bool Pending() const {
+            return next != nullptr;
+        }
+    };
+
+  private:
+    static constexpr uint64_t SlotMask{(1ULL << SlotBits) - 1};
+    static constexpr size_t SlotCount{1ULL << SlotBits};
+
+    std::array<std::array<Link, SlotCount>, Levels> mSlots; //!< Each slot is the sentinel of a circular list of timers
+    std::array<uint64_t, Levels> mOccupied{}; //!< A bit for every slot that has timers in it
+    uint64_t mNow;
+
+    void Insert(Timer &timer);
+
+    void Unlink(Timer &timer);
+
+    void Cascade(int level, size_t slot);
+
+  public:
+    explicit TimerWheel(uint64_t now = 0);
+
+    TimerWheel(const TimerWheel &) = delete;
+
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    uint64_t Now() const {
+        return mNow;
+    }
+
+    /**
+     * @brief Schedules the timer to fire |delay| ticks from now, a pending timer is rescheduled
+     */
+    void Schedule(Timer &timer, uint64_t delay);
+
+    void Cancel(Timer &timer);
+
+    /**
+     * @brief Fires all timers that have expired up to and including |now|, in order of expiry
+     */
+    void Advance(uint64_t now);
+
+    /**
+     * @return The tick at which Advance needs to be called next, this is before the earliest expiry while a long timer still has to be cascaded to a lower level
+     */
+    std::optional<uint64_t> NextWakeup() const;
+};
+
+} // namespace inputhook
+
+#endif // INPUTHOOK_TIMER_WHEEL_H
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <array>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include "Metrics.h"
+#include "Trace.h"
+
+namespace inputhook {
+namespace trace {
+
+std::atomic_bool enabled{};
+
+namespace {
+    struct PointInfo {
+        const char *name;
+        std::array<const char *, 3> args; //!< nullptr for unused arguments
+    };
+
+    constexpr std::array<PointInfo, static_cast<size_t>(Point::Count)> Points{{
+        {"UInputWrite", {"count", "errno", nullptr}},
+        {"UInputIoctl", {"request", "value", "errno"}},
+        {"InjectorSend", {"type", "code", "value"}},
+        {"NewDevice", {"id", "vendor", "product"}},
+        {"CloseDevice", {"id", nullptr, nullptr}},
+    }};
+
+    /**
+     * @brief A single producer ring buffer that's owned by one thread, the oldest records are overwritten once it's full
+     */
+    struct Ring {
+        static constexpr size_t Capacity{4096}; //!< Must be a power of two
+
+        pid_t tid;
+        std::atomic<uint64_t> head{}; //!< The total amount of records ever written
+        std::array<Record, Capacity> records;
+
+        explicit Ring(pid_t tid) : tid(tid) {}
+    };
+
+    std::mutex ringsMutex; //!< Only taken when a thread records its first trace point and while exporting
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    Ring &ThreadRing() {
+        thread_local Ring *ring{[] {
+            std::scoped_lock lock{ringsMutex};
+            return rings.emplace_back(std::make_unique<Ring>(gettid())).get();
+        }()};
+        return *ring;
+    }
+}
+
+void Emit(Point point, int32_t arg0, int32_t arg1, int32_t arg2) {
+    auto &ring{ThreadRing()};
+    auto head{ring.head.load(std::memory_order_relaxed)};
+    ring.records[head & (Ring::Capacity - 1)] = Record{metrics::NowNs(), point, {arg0, arg1, arg2}};
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void SetEnabled(bool enable) {
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+void Clear() {
+    std::scoped_lock lock{ringsMutex};
+    for (auto &ring : rings)
+        ring->head.store(0, std::memory_order_relaxed);
+}
+
+void Export(int fd) {
+    std::scoped_lock lock{ringsMutex};
+
+    auto pid{getpid()};
+    bool first{true};
+    dprintf(fd, "{\"traceEvents\":[\n");
+    for (auto &ring : rings) {
+        // Records that are being written concurrently may be torn, this is only a concern when exporting while tracing
+        auto head{ring->head.load(std::memory_order_acquire)};
+        for (auto i{head > Ring::Capacity ? head - Ring::Capacity : 0}; i < head; i++) {
+            auto &record{ring->records[i & (Ring::Capacity - 1)]};
+            auto index{static_cast<size_t>(record.point)};
+            if (index >= Points.size())
+                continue;
+
+            auto &info{Points[index]};
+            dprintf(fd, "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%" PRIu64 ".%03" PRIu64 ",\"pid\":%d,\"tid\":%d,\"args\":{",
+                    first ? "" : ",\n", info.name, record.timestamp / 1000, record.timestamp % 1000, pid, ring->tid);
+            for (size_t arg{}; arg < info.args.size() && info.args[arg]; arg++)
+                dprintf(fd, "%s\"%s\":%" PRId32, arg ? "," : "", info.args[arg], record.args[arg]);
+            dprintf(fd, "}}");
+            first = false;
+        }
+    }
+    dprintf(fd, "\n],\"displayTimeUnit\":\"ns\"}\n");
+}
+
+} // namespace trace
+} // namespace inputhook
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_TRACE_H
+#define INPUTHOOK_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace inputhook {
+namespace trace {
+
+//! Every trace point, the names and argument names used for exporting are in Trace.cpp
+enum class Point : uint16_t {
+    UInputWrite,
+    UInputIoctl,
+    InjectorSend,
+    NewDevice,
+    CloseDevice,
+    Count,
+};
+
+//! A single binary trace record, nothing is formatted until the trace is exported
+struct Record {
+    uint64_t timestamp; //!< CLOCK_MONOTONIC in nanoseconds
+    Point point;
+    int32_t args[3];
+};
+
+extern std::atomic_bool enabled;
+
+//! Appends a record to the calling thread's ring buffer, use Trace() instead of calling this directly
+void Emit(Point point, int32_t arg0, int32_t arg1, int32_t arg2);
+
+/**
+ * @brief Records a trace point if tracing is enabled, when it's disabled this is a single relaxed load and branch
+ */
+inline void Trace(Point point, int32_t arg0 = 0, int32_t arg1 = 0, int32_t arg2 = 0) {
+    if (__builtin_expect(enabled.load(std::memory_order_relaxed), false))
+        Emit(point, arg0, arg1, arg2);
+}
+
+void SetEnabled(bool enable);
+
+//! Clears the ring buffers of all threads, this must not be called while tracing is enabled
+void Clear();
+
+//! Writes all recorded trace points to the given fd in the Chrome JSON trace format, which can be opened in Perfetto UI
+void Export(int fd);
+
+} // namespace trace
+} // namespace inputhook
+
+#endif // INPUTHOOK_TRACE_H
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Tunables"
+
+// #define LOG_NDEBUG 0
+
+#include <android/log.h>
+#include <climits>
+#include <cstring>
+#include <log/log.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "Config.h"
+#include "Metrics.h"
+#include "Tunables.h"
+
+namespace inputhook {
+namespace tunables {
+    constexpr const char *OverrideDir{"/data/vendor/inputhook"};
+    constexpr const char *FileName{"tunables.conf"};
+
+    static const Tunables Defaults{};
+    std::atomic<const Tunables *> current{&Defaults};
+
+    //! Applies every setting in |path| on top of |tunables|
+    //! @return If the file could be read
+    static bool Parse(const std::string &path, Tunables &tunables) {
+        return config::ForEachLine(path.c_str(), [&](const std::vector<std::string_view> &tokens, int lineNo) {
+            auto name{tokens[0]};
+            float value{};
+            int32_t ints[2]{};
+            bool valid{};
+            if ((name == "deadzone" || name == "power" || name == "speed") && tokens.size() == 2 && config::ParseFloat(tokens[1], value)) {
+                if (name == "deadzone" && value >= 0.0f && value < 1.0f) {
+                    tunables.deadzone = value;
+                    valid = true;
+                } else if (name == "power" && value > 0.0f) {
+                    tunables.power = value;
+                    valid = true;
+                } else if (name == "speed") {
+                    tunables.speed = value;
+                    valid = true;
+                }
+            } else if ((name == "update_interval_ms" || name == "fade_time_ms") && tokens.size() == 2 && config::ParseInt(tokens[1], ints[0]) && ints[0] > 0) {
+                (name == "update_interval_ms" ? tunables.updateInterval : tunables.fadeTime) = std::chrono::milliseconds{ints[0]};
+                valid = true;
+            } else if ((name == "left_click" || name == "right_click") && tokens.size() == 3 && config::ParseInt(tokens[1], ints[0]) && config::ParseInt(tokens[2], ints[1])) {
+                if ((ints[0] == EV_KEY && ints[1] >= 0 && ints[1] < KEY_CNT) || (ints[0] == EV_ABS && ints[1] >= 0 && ints[1] < ABS_CNT)) {
+                    (name == "left_click" ? tunables.leftClick : tunables.rightClick) = {static_cast<uint16_t>(ints[0]), static_cast<uint16_t>(ints[1])};
+                    valid = true;
+                }
+            } else if (name == "toggle_key" && tokens.size() == 2 && config::ParseInt(tokens[1], ints[0]) && ints[0] >= 0 && ints[0] < KEY_CNT) {
+                tunables.toggleKey = static_cast<uint16_t>(ints[0]);
+                valid = true;
+            }
+
+            if (!valid)
+                ALOGW("%s:%d: Invalid tunable, ignoring it", path.c_str(), lineNo);
+        });
+    }
+}
+
+TunablesWatcher::TunablesWatcher(Reactor &reactor) : mReactor(reactor) {
+    mReclaimTimer = mReactor.AddTimer({}, {}, [this](uint64_t) { Reclaim(); });
+}
+
+TunablesWatcher::~TunablesWatcher() {
+    mReactor.RemoveFd(mInotifyHandle);
+    mReactor.RemoveTimer(mReclaimTimer);
+    tunables::current.store(&tunables::Defaults, std::memory_order_release);
+}
+
+void TunablesWatcher::Load() {
+    auto tunables{std::make_unique<Tunables>()};
+    bool found{tunables::Parse(std::string{config::Dir} + "/" + tunables::FileName, *tunables)};
+    found |= tunables::Parse(std::string{tunables::OverrideDir} + "/" + tunables::FileName, *tunables);
+
+    std::scoped_lock lock{mMutex};
+    if (!found && !mCurrent)
+        return; // Keep the static defaults published
+
+    tunables->generation = ++mGeneration;
+    tunables::current.store(tunables.get(), std::memory_order_release);
+
+    if (mCurrent) {
+        auto now{metrics::NowNs()};
+        mRetired.emplace_back(now, std::move(mCurrent));
+        Reactor::ArmTimer(mReclaimTimer, mRetired.front().first + static_cast<uint64_t>(std::chrono::nanoseconds{tunables::GracePeriod}.count()));
+    }
+    mCurrent = std::move(tunables);
+    ALOGI("Loaded tunables (generation %u)", mGeneration);
+}
+
+void TunablesWatcher::Reclaim() {
+    std::scoped_lock lock{mMutex};
+    auto grace{static_cast<uint64_t>(std::chrono::nanoseconds{tunables::GracePeriod}.count())};
+    auto now{metrics::NowNs()};
+
+    size_t expired{};
+    while (expired < mRetired.size() && mRetired[expired].first + grace <= now)
+        expired++;
+    mRetired.erase(mRetired.begin(), mRetired.begin() + static_cast<ptrdiff_t>(expired));
+
+    if (!mRetired.empty())
+        Reactor::ArmTimer(mReclaimTimer, mRetired.front().first + grace);
+}
+
+void TunablesWatcher::Watch() {
+    if (mInotifyHandle)
+        return;
+
+    mInotifyFd.reset(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+    if (mInotifyFd.get() < 0) {
+        ALOGE("Failed to create inotify fd: %d", errno);
+        return;
+    }
+
+    // The directory is watched rather than the file so that atomic replacements and files created later are picked up
+    if (inotify_add_watch(mInotifyFd.get(), tunables::OverrideDir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) < 0) {
+        ALOGW("Not watching %s for tunables: %d", tunables::OverrideDir, errno);
+        mInotifyFd.reset();
+        return;
+    }
+
+    int fd{mInotifyFd.get()};
+    mInotifyHandle = mReactor.AddFd(fd, EPOLLIN, [this, fd](uint32_t) {
+        alignas(inotify_event) char buffer[sizeof(inotify_event) + NAME_MAX + 1];
+        bool changed{};
+        ssize_t length;
+        while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+            for (char *ptr{buffer}; ptr < buffer + length;) {
+                auto event{reinterpret_cast<inotify_event *>(ptr)};
+                if (event->len && std::strcmp(event->name, tunables::FileName) == 0)
+                    changed = true;
+                ptr += sizeof(inotify_event) + event->len;
+            }
+        }
+
+        if (changed)
+            Load();
+    });
+
+    Load(); // Pick up anything written before we started watching
+}
+
+void TunablesWatcher::Dump(int fd) {
+    auto &tunables{tunables::Current()};
+    std::scoped_lock lock{mMutex};
+    dprintf(fd, "Tunables (generation %u, %zu retired, %s):\n", tunables.generation, mRetired.size(), mInotifyHandle ? "watching" : "not watching");
+    dprintf(fd, "  deadzone %.3f power %.3f speed %.3f update_interval_ms %lld fade_time_ms %lld\n", tunables.deadzone, tunables.power, tunables.speed,
+            static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(tunables.updateInterval).count()),
+            static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(tunables.fadeTime).count()));
+    dprintf(fd, "  left_click %#x %#x right_click %#x %#x toggle_key %#x\n", tunables.leftClick.type, tunables.leftClick.code,
+            tunables.rightClick.type, tunables.rightClick.code, tunables.toggleKey);
+}
+
+} // namespace inputhook
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_TUNABLES_H
+#define INPUTHOOK_TUNABLES_H
+
+#include <android-base/unique_fd.h>
+#include <atomic>
+#include <chrono>
+#include <linux/input.h>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "Reactor.h"
+
+namespace inputhook {
+
+//! An immutable snapshot of every runtime tunable, the defaults match the values RsMouse was originally built with
+struct Tunables {
+    struct Trigger {
+        uint16_t type;
+        uint16_t code;
+
+        bool Matches(uint16_t eventType, uint16_t eventCode) const {
+            return type == eventType && code == eventCode;
+        }
+    };
+
+    float deadzone{0.1f};
+    float power{3.0f}; //!< Power for cursor velocity curve
+    float speed{27.0f}; //!< Coefficient for the final output cursor speed
+    std::chrono::nanoseconds updateInterval{std::chrono::milliseconds{1000} / 60}; //!< 60Hz update rate
+    std::chrono::nanoseconds fadeTime{std::chrono::seconds{5}}; //!< Maximum time it takes the cursor to fade (should match frameworks/base/libs/input/PointerController.cpp)
+    Trigger leftClick{EV_ABS, ABS_RZ}; //!< The input that's turned into a left click while the cursor is visible
+    Trigger rightClick{EV_KEY, BTN_TR};
+    uint16_t toggleKey{BTN_Z}; //!< Releasing this key toggles RsMouse on and off
+    uint32_t generation{}; //!< Incremented on every reload
+};
+
+namespace tunables {
+    extern std::atomic<const Tunables *> current;
+
+    //! @return The current snapshot, it stays valid for at least GracePeriod after being replaced so it must not be held onto for longer than that
+    inline const Tunables &Current() {
+        return *current.load(std::memory_order_acquire);
+    }
+
+    constexpr auto GracePeriod{std::chrono::seconds{1}};
+}
+
+/**
+ * @brief Loads tunables from the vendor config and the writable override in /data, the override is reloaded whenever it changes
+ * @note Readers are never blocked by a reload, a new snapshot is published with a single atomic store and the old one is freed after a grace period
+ */
+class TunablesWatcher {
+  private:
+    Reactor &mReactor;
+    android::base::unique_fd mInotifyFd;
+    Reactor::Handle mInotifyHandle{};
+    Reactor::Timer mReclaimTimer; //!< Armed for when the oldest retired snapshot can be freed
+
+    std::mutex mMutex; //!< Protects everything below
+    std::unique_ptr<Tunables> mCurrent; //!< Null until something is loaded, the static defaults are published until then
+    std::vector<std::pair<uint64_t, std::unique_ptr<Tunables>>> mRetired; //!< Replaced snapshots and when they were replaced
+    uint32_t mGeneration{};
+
+    void Reclaim();
+
+  public:
+    explicit TunablesWatcher(Reactor &reactor);
+
+    ~TunablesWatcher();
+
+    //! Reads the config files and publishes the result as the current snapshot
+    void Load();
+
+    //! Starts watching the override file for changes, this has to be deferred until /data is mounted
+    void Watch();
+
+    void Dump(int fd);
+};
+
+} // namespace inputhook
+
+#endif // INPUTHOOK_TUNABLES_H
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VirtualDevices"
+
+// #define LOG_NDEBUG 0
+
+#include <algorithm>
+#include <android/log.h>
+#include <cutils/properties.h>
+#include <log/log.h>
+#include <sys/epoll.h>
+#include "Metrics.h"
+#include "VirtualDevices.h"
+
+namespace inputhook {
+namespace budget {
+    constexpr const char *MaxDevicesProperty{"persist.vendor.inputhook.vdev.max_devices"};
+    constexpr const char *MaxKibProperty{"persist.vendor.inputhook.vdev.max_kib"};
+    constexpr const char *MaxIdleProperty{"persist.vendor.inputhook.vdev.max_idle"};
+    constexpr size_t DeviceBytes{4096}; //!< The input_dev, evdev and their sysfs nodes, the exact size depends on the kernel config
+    constexpr size_t EvdevMinBuffer{64}; //!< EVDEV_MIN_BUFFER_SIZE
+    constexpr size_t EvdevBufPackets{8}; //!< EVDEV_BUF_PACKETS
+    constexpr size_t KernelObjects{3}; //!< The uinput device, its input_dev and the evdev node
+}
+
+namespace profile {
+    DeviceProfile Mouse(std::string name) {
+        DeviceProfile profile{.name = std::move(name)};
+        profile.properties = {INPUT_PROP_POINTER};
+        profile.keys = {BTN_LEFT, BTN_RIGHT};
+        profile.rels = {REL_X, REL_Y};
+        profile.miscs = {MSC_SERIAL};
+        return profile;
+    }
+
+    DeviceProfile Keyboard(std::string name, std::vector<uint16_t> keys) {
+        DeviceProfile profile{.name = std::move(name)};
+        profile.keys = std::move(keys);
+        return profile;
+    }
+
+    DeviceProfile Touchscreen(std::string name, int32_t width, int32_t height, int32_t slots) {
+        DeviceProfile profile{.name = std::move(name)};
+        profile.properties = {INPUT_PROP_DIRECT};
+        profile.keys = {BTN_TOUCH};
+        profile.axes = {
+            {ABS_MT_POSITION_X, 0, width - 1, 0, 0},
+            {ABS_MT_POSITION_Y, 0, height - 1, 0, 0},
+            {ABS_MT_TRACKING_ID, 0, UINT16_MAX, 0, 0},
+        };
+        profile.touchSlots = slots;
+        return profile;
+    }
+
+    DeviceProfile Gamepad(std::string name) {
+        DeviceProfile profile{.name = std::move(name)};
+        profile.keys = {BTN_SOUTH, BTN_EAST, BTN_NORTH, BTN_WEST, BTN_TL, BTN_TR, BTN_SELECT, BTN_START, BTN_MODE, BTN_THUMBL, BTN_THUMBR};
+        profile.axes = {
+            {ABS_X, -32768, 32767, 16, 128},
+            {ABS_Y, -32768, 32767, 16, 128},
+            {ABS_RX, -32768, 32767, 16, 128},
+            {ABS_RY, -32768, 32767, 16, 128},
+            {ABS_Z, 0, 255, 0, 0},
+            {ABS_RZ, 0, 255, 0, 0},
+            {ABS_HAT0X, -1, 1, 0, 0},
+            {ABS_HAT0Y, -1, 1, 0, 0},
+        };
+        profile.ffEffects = 16;
+        return profile;
+    }
+}
+
+VirtualDevices::VirtualDevices(Reactor &reactor, LatencyProbe &probe)
+    : mReactor(reactor), mProbe(probe) {
+    LoadBudget();
+}
+
+VirtualDevices::~VirtualDevices() {
+    std::scoped_lock lock{mMutex};
+    while (!mEntries.empty())
+        Destroy(mEntries.begin());
+}
+
+size_t VirtualDevices::EstimateBytes(const DeviceProfile &profile) {
+    // Mirrors input_estimate_events_per_packet() which sizes the evdev buffer of every reader
+    auto isMtAxis{[](uint16_t code) { return code >= ABS_MT_SLOT && code <= ABS_MT_TOOL_Y; }};
+    size_t slots{static_cast<size_t>(profile.touchSlots)};
+    size_t events{slots + 1};
+    for (auto &axis : profile.axes)
+        events += isMtAxis(axis.code) ? slots : 1;
+    if (slots)
+        events += slots; // ABS_MT_SLOT
+    events += profile.rels.size() + 7;
+
+    size_t bufferEvents{1};
+    while (bufferEvents < std::max(budget::EvdevMinBuffer, events * budget::EvdevBufPackets))
+        bufferEvents <<= 1;
+
+    size_t bytes{budget::DeviceBytes + bufferEvents * sizeof(input_event)};
+    if (!profile.axes.empty() || slots)
+        bytes += ABS_CNT * sizeof(input_absinfo);
+    bytes += profile.ffEffects * sizeof(ff_effect);
+    return bytes;
+}
+
+size_t VirtualDevices::UsedBytes() const {
+    size_t bytes{};
+    for (auto &entry : mEntries)
+        bytes += entry->estimatedBytes;
+    return bytes;
+}
+
+size_t VirtualDevices::IdleCount() const {
+    return static_cast<size_t>(std::count_if(mEntries.begin(), mEntries.end(), [](auto &entry) { return entry->leases == 0; }));
+}
+
+bool VirtualDevices::EvictIdle() {
+    auto idle{std::find_if(mEntries.begin(), mEntries.end(), [](auto &entry) { return entry->leases == 0; })};
+    if (idle == mEntries.end())
+        return false;
+
+    Destroy(idle);
+    return true;
+}
+
+void VirtualDevices::Destroy(std::vector<std::unique_ptr<Entry>>::iterator entry) {
+    mReactor.RemoveFd((*entry)->feedbackHandle);
+    ALOGI("Destroyed virtual device %s/%u", (*entry)->profile.name.c_str(), (*entry)->slot);
+    mEntries.erase(entry);
+}
+
+void VirtualDevices::LoadBudget() {
+    std::scoped_lock lock{mMutex};
+    mMaxDevices = static_cast<size_t>(property_get_int32(budget::MaxDevicesProperty, 8));
+    mMaxBytes = static_cast<size_t>(property_get_int32(budget::MaxKibProperty, 512)) * 1024;
+    mMaxIdle = static_cast<size_t>(property_get_int32(budget::MaxIdleProperty, 0));
+
+    while (IdleCount() > mMaxIdle)
+        EvictIdle();
+}
+
+VirtualDevices::Lease VirtualDevices::Acquire(const DeviceProfile &profile, uint8_t slot) {
+    std::scoped_lock lock{mMutex};
+
+    for (auto &entry : mEntries) {
+        if (entry->slot == slot && entry->profile.name == profile.name) {
+            if (entry->leases++ == 0)
+                mReused++;
+            return Lease{this, entry.get()};
+        }
+    }
+
+    auto estimatedBytes{EstimateBytes(profile)};
+    while (mEntries.size() + 1 > mMaxDevices || UsedBytes() + estimatedBytes > mMaxBytes) {
+        if (!EvictIdle()) {
+            ALOGE("Not creating virtual device %s/%u, it would exceed the budget of %zu devices and %zu KiB", profile.name.c_str(), slot, mMaxDevices, mMaxBytes / 1024);
+            mDenied++;
+            return {};
+        }
+    }
+
+    auto start{metrics::NowNs()};
+    auto entry{std::make_unique<Entry>(Entry{.profile = profile, .slot = slot, .injector = std::make_unique<EvdevInjector>()})};
+    auto &injector{*entry->injector};
+    injector.ConfigureBegin(profile.name.c_str(), profile.bus, profile.vid, profile.pid, profile.version);
+    for (auto property : profile.properties)
+        injector.ConfigureInputProperty(property);
+    for (auto key : profile.keys)
+        injector.ConfigureKey(key);
+    for (auto rel : profile.rels)
+        injector.ConfigureRel(rel);
+    for (auto misc : profile.miscs)
+        injector.ConfigureMisc(misc);
+    for (auto &axis : profile.axes)
+        injector.ConfigureAbs(axis.code, axis.min, axis.max, axis.fuzz, axis.flat);
+    if (profile.touchSlots)
+        injector.ConfigureAbsSlots(profile.touchSlots - 1);
+    if (profile.ffEffects)
+        injector.ConfigureForceFeedback(FF_RUMBLE, profile.ffEffects);
+    injector.ConfigureEnd();
+
+    // The injector closes the uinput fd when destroyed, so there's nothing to clean up on failure
+    if (auto ret{injector.GetError()}) {
+        ALOGE("Failed to create virtual device %s/%u: %d", profile.name.c_str(), slot, ret);
+        return {};
+    }
+
+    entry->feedbackHandle = mReactor.AddFd(injector.GetFd(), EPOLLIN, [&injector](uint32_t) { injector.HandleFeedback(); });
+    entry->leases = 1;
+    entry->setupNs = metrics::NowNs() - start;
+    entry->estimatedBytes = estimatedBytes;
+    metrics::registry.virtualDeviceCreate.Record(entry->setupNs);
+    mCreated++;
+    ALOGI("Created virtual device %s/%u", profile.name.c_str(), slot);
+
+    mEntries.push_back(std::move(entry));
+    return Lease{this, mEntries.back().get()};
+}
+
+void VirtualDevices::Release(Entry *entry) {
+    std::scoped_lock lock{mMutex};
+    if (--entry->leases)
+        return;
+
+    // Idle devices stay registered so they can be reused without going through uinput setup again
+    if (IdleCount() <= mMaxIdle)
+        return;
+
+    Destroy(std::find_if(mEntries.begin(), mEntries.end(), [entry](auto &other) { return other.get() == entry; }));
+}
+
+void VirtualDevices::Dump(int fd) {
+    std::scoped_lock lock{mMutex};
+    dprintf(fd, "Virtual devices: %zu/%zu, %zu/%zu KiB estimated, %zu created, %zu reused, %zu denied\n",
+            mEntries.size(), mMaxDevices, UsedBytes() / 1024, mMaxBytes / 1024, mCreated, mReused, mDenied);
+    if (mEntries.empty())
+        return;
+
+    dprintf(fd, "  %-24s %4s %6s %4s %7s %6s %10s\n", "", "slot", "leases", "fds", "objects", "KiB", "setup (ms)");
+    for (auto &entry : mEntries)
+        dprintf(fd, "  %-24s %4u %6zu %4d %7zu %6zu %10.3f\n", entry->profile.name.c_str(), entry->slot, entry->leases, EvdevInjector::UInput::kFds,
+                budget::KernelObjects + (entry->profile.ffEffects ? 1 : 0), entry->estimatedBytes / 1024, entry->setupNs / 1e6);
+}
+
+} // namespace inputhook
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_VIRTUAL_DEVICES_H
+#define INPUTHOOK_VIRTUAL_DEVICES_H
+
+#include <linux/input.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "EvdevInjector.h"
+#include "LatencyProbe.h"
+#include "Reactor.h"
+
+namespace inputhook {
+
+//! Everything needed to configure a virtual input device, devices with the same name and slot are shared
+struct DeviceProfile {
+    struct Axis {
+        uint16_t code;
+        int32_t min, max, fuzz, flat;
+    };
+
+    std::string name;
+    int16_t bus{BUS_BLUETOOTH}; //!< Pretend to be bluetooth as not all apps will accept virtual devices
+    int16_t vid{}; //!< 0 PID/VID is used to identify internal devices
+    int16_t pid{};
+    int16_t version{1};
+    std::vector<uint16_t> properties;
+    std::vector<uint16_t> keys;
+    std::vector<uint16_t> rels;
+    std::vector<uint16_t> miscs;
+    std::vector<Axis> axes;
+    int32_t touchSlots{}; //!< The amount of multi-touch slots or 0 if the device isn't multi-touch
+    uint32_t ffEffects{}; //!< The amount of rumble effects that can be uploaded or 0 for no force feedback
+};
+
+namespace profile {
+    //! A relative pointer with left/right buttons, MSC_SERIAL is enabled for the latency probe
+    DeviceProfile Mouse(std::string name);
+
+    DeviceProfile Keyboard(std::string name, std::vector<uint16_t> keys);
+
+    DeviceProfile Touchscreen(std::string name, int32_t width, int32_t height, int32_t slots = 10);
+
+    //! A dual stick gamepad with analog triggers and rumble
+    DeviceProfile Gamepad(std::string name);
+}
+
+/**
+ * @brief Owns every virtual input device we create, features lease devices from it by profile rather than setting up their own
+ * @note Every device is created and configured the same way, has its force feedback handled on the reactor and is torn down when its last lease goes unless it's kept idle for reuse
+ * @note A budget on the amount of devices and their estimated kernel memory is enforced, idle devices are evicted first to make room
+ */
+class VirtualDevices {
+  private:
+    struct Entry {
+        DeviceProfile profile;
+        uint8_t slot; //!< Distinguishes multiple devices of the same profile, e.g. one per player
+        std::unique_ptr<EvdevInjector> injector;
+        Reactor::Handle feedbackHandle{};
+        size_t leases{};
+        uint64_t setupNs{}; //!< How long creating and configuring the device took
+        size_t estimatedBytes{}; //!< The estimated kernel memory used by the device, see EstimateBytes
+    };
+
+    Reactor &mReactor;
+    LatencyProbe &mProbe;
+
+    std::mutex mMutex; //!< Protects everything below
+    size_t mMaxDevices{};
+    size_t mMaxBytes{};
+    size_t mMaxIdle{}; //!< How many devices without leases are kept around for reuse
+    std::vector<std::unique_ptr<Entry>> mEntries;
+    size_t mCreated{}, mReused{}, mDenied{};
+
+    //! @return A rough estimate of the kernel memory a device with this profile takes, including the evdev buffer of a single reader
+    static size_t EstimateBytes(const DeviceProfile &profile);
+
+    size_t UsedBytes() const;
+
+    size_t IdleCount() const;
+
+    //! Destroys the oldest idle device
+    //! @return If there was an idle device to destroy
+    bool EvictIdle();
+
+    void Destroy(std::vector<std::unique_ptr<Entry>>::iterator entry);
+
+    void Release(Entry *entry);
+
+  public:
+    //! A lease on a virtual device, the device is released when this is destroyed
+    class Lease {
+      private:
+        VirtualDevices *mOwner{};
+        Entry *mEntry{};
+
+        friend class VirtualDevices;
+
+        Lease(VirtualDevices *owner, Entry *entry) : mOwner(owner), mEntry(entry) {}
+
+      public:
+        Lease() = default;
+
+        Lease(Lease &&other) noexcept : mOwner(other.mOwner), mEntry(other.mEntry) {
+            other.mEntry = nullptr;
+        }
+
+        Lease &operator=(Lease &&other) noexcept {
+            if (this != &other) {
+                Reset();
+                mOwner = other.mOwner;
+                mEntry = other.mEntry;
+                other.mEntry = nullptr;
+            }
+            return *this;
+        }
+
+        ~Lease() {
+            Reset();
+        }
+
+        void Reset() {
+            if (mEntry)
+                mOwner->Release(mEntry);
+            mEntry = nullptr;
+        }
+
+        explicit operator bool() const {
+            return mEntry != nullptr;
+        }
+
+        EvdevInjector *operator->() const {
+            return mEntry->injector.get();
+        }
+
+        EvdevInjector &operator*() const {
+            return *mEntry->injector;
+        }
+    };
+
+    VirtualDevices(Reactor &reactor, LatencyProbe &probe);
+
+    ~VirtualDevices();
+
+    //! Reads the budget from the persist.vendor.inputhook.vdev.* properties, idle devices that no longer fit are destroyed
+    //! @note This has to be called again once persistent properties are loaded, at early boot they all read as the defaults
+    void LoadBudget();
+
+    //! @return A lease on the device with the given profile and slot, an existing one is reused if possible
+    //! @note The lease is empty if the device couldn't be created or doesn't fit in the budget
+    Lease Acquire(const DeviceProfile &profile, uint8_t slot = 0);
+
+    //! Writes every device and its cost to the given fd
+    void Dump(int fd);
+};
+
+} // namespace inputhook
+
+#endif // INPUTHOOK_VIRTUAL_DEVICES_H
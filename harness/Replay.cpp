@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputHookReplay"
+
+// #define LOG_NDEBUG 0
+
+#include <chrono>
+#include <cinttypes>
+#include <thread>
+#include <android/log.h>
+#include <log/log.h>
+#include "Allocations.h"
+#include "Config.h"
+#include "Metrics.h"
+#include "Replay.h"
+
+namespace vendor {
+namespace nvidia {
+namespace hardware {
+namespace shieldtech {
+namespace inputflinger {
+namespace V2_0 {
+namespace implementation {
+
+bool ReplayTrace(InputHook &hook, const char *path, int out) {
+    metrics::Histogram dispatch; //!< filterEvent, as every event in the trace reaches the full filter chain
+    metrics::Histogram motion; //!< notifyMotionState
+    auto ticksBefore{metrics::registry.cursorTick.Summarise()};
+    size_t errors{};
+
+    auto start{metrics::NowNs()};
+    bool read{config::ForEachLine(path, [&](const std::vector<std::string_view> &tokens, int lineNo) {
+        auto command{tokens[0]};
+        int32_t args[4]{};
+        float coords[2]{};
+        for (size_t i{1}; i < tokens.size() && i <= 4; i++) {
+            bool isCoord{command == "motion" && (i == 2 || i == 3)};
+            if (!(isCoord ? config::ParseFloat(tokens[i], coords[i - 2]) : config::ParseInt(tokens[i], args[i - 1])))
+                errors++;
+        }
+
+        if (command == "add" && tokens.size() == 5) {
+            hook.addDevice(args[0], args[1], args[2], args[3] ? RightStickAxes::RxRy : RightStickAxes::None, nullptr);
+        } else if (command == "remove" && tokens.size() == 2) {
+            hook.removeDevice(args[0]);
+        } else if (command == "event" && tokens.size() == 5) {
+            HidlInputEvent iev{};
+            iev.when = static_cast<int64_t>(metrics::NowNs());
+            iev.type = args[1];
+            iev.code = args[2];
+            iev.value = args[3];
+
+            auto eventStart{metrics::NowNs()};
+            hook.filterEvent(iev, args[0], [](Response, int32_t, const HidlInputEvent &) {});
+            dispatch.Record(metrics::NowNs() - eventStart);
+        } else if (command == "motion" && tokens.size() == 5) {
+            AnalogCoords pc{};
+            pc.rsX = coords[0];
+            pc.rsY = coords[1];
+
+            auto motionStart{metrics::NowNs()};
+            hook.notifyMotionState(args[0], pc, args[3] != 0);
+            motion.Record(metrics::NowNs() - motionStart);
+        } else if (command == "wait" && tokens.size() == 2) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{args[0]});
+        } else {
+            ALOGW("%s:%d: Unknown or malformed replay command", path, lineNo);
+            errors++;
+        }
+    })};
+    auto elapsed{metrics::NowNs() - start};
+
+    if (!read) {
+        dprintf(out, "Failed to read replay trace: %s\n", path);
+        return false;
+    }
+
+    auto ticksAfter{metrics::registry.cursorTick.Summarise()};
+    dprintf(out, "Replayed %s in %.1fms (%zu malformed lines)\n", path, static_cast<double>(elapsed) / 1e6, errors);
+    dprintf(out, "Latency (us):\n");
+    dprintf(out, "  %-20s %10s %10s %10s %10s %10s %10s\n", "", "count", "mean", "p50", "p90", "p99", "max");
+    metrics::DumpHistogram(out, "dispatch", dispatch);
+    metrics::DumpHistogram(out, "motion", motion);
+    metrics::DumpHistogram(out, "cursorTick (total)", metrics::registry.cursorTick);
+    dprintf(out, "Cursor ticks during replay: %" PRIu64 "\n", ticksAfter.count - ticksBefore.count);
+    alloc::Dump(out);
+
+    return errors == 0;
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace inputflinger
+}  // namespace shieldtech
+}  // namespace hardware
+}  // namespace nvidia
+}  // namespace vendor
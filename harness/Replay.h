@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VENDOR_NVIDIA_HARDWARE_SHIELDTECH_INPUTFLINGER_V2_0_REPLAY_H
+#define VENDOR_NVIDIA_HARDWARE_SHIELDTECH_INPUTFLINGER_V2_0_REPLAY_H
+
+#include "InputHook.h"
+
+namespace vendor {
+namespace nvidia {
+namespace hardware {
+namespace shieldtech {
+namespace inputflinger {
+namespace V2_0 {
+namespace implementation {
+
+/**
+ * @brief Feeds a recorded event trace through the same entry points InputFlinger calls and reports how long they took
+ * @note This is the training workload for the PGO build variant, an instrumented inputhook_harness writes the profile out once every trace has been replayed
+ * @note Trace lines are one of:
+ *       add <id> <vid> <pid> <has right stick>
+ *       remove <id>
+ *       event <id> <type> <code> <value>
+ *       motion <id> <rs x> <rs y> <handled>
+ *       wait <ms>
+ */
+bool ReplayTrace(InputHook &hook, const char *path, int out);
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace inputflinger
+}  // namespace shieldtech
+}  // namespace hardware
+}  // namespace nvidia
+}  // namespace vendor
+
+#endif  // VENDOR_NVIDIA_HARDWARE_SHIELDTECH_INPUTFLINGER_V2_0_REPLAY_H
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <sys/resource.h>
+#include "Metrics.h"
+#include "ResourceMonitor.h"
+
+namespace inputhook {
+
+static size_t ReadRssKib() {
+    size_t rss{};
+    if (FILE *status{fopen("/proc/self/status", "re")}) {
+        char line[128];
+        while (fgets(line, sizeof(line), status)) {
+            if (sscanf(line, "VmRSS: %zu kB", &rss) == 1)
+                break;
+        }
+        fclose(status);
+    }
+    return rss;
+}
+
+static size_t CountFds() {
+    size_t fds{};
+    if (DIR *dir{opendir("/proc/self/fd")}) {
+        while (dirent *entry{readdir(dir)}) {
+            if (entry->d_name[0] != '.')
+                fds++;
+        }
+        closedir(dir);
+        fds--; // The directory we're reading
+    }
+    return fds;
+}
+
+ResourceUsage ResourceUsage::Sample() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+
+    auto toNs{[](const timeval &time) { return static_cast<uint64_t>(time.tv_sec) * 1000000000 + static_cast<uint64_t>(time.tv_usec) * 1000; }};
+    return ResourceUsage{
+        .time = metrics::NowNs(),
+        .cpuNs = toNs(usage.ru_utime) + toNs(usage.ru_stime),
+        .voluntarySwitches = static_cast<uint64_t>(usage.ru_nvcsw),
+        .involuntarySwitches = static_cast<uint64_t>(usage.ru_nivcsw),
+        .reactorWakeups = metrics::registry.reactorWakeups.Sum(),
+        .rssKib = ReadRssKib(),
+        .fds = CountFds(),
+    };
+}
+
+} // namespace inputhook
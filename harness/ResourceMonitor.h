@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_RESOURCE_MONITOR_H
+#define INPUTHOOK_RESOURCE_MONITOR_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace inputhook {
+
+//! A snapshot of the resources used by the whole service
+struct ResourceUsage {
+    uint64_t time; //!< CLOCK_MONOTONIC in nanoseconds
+    uint64_t cpuNs; //!< User and system time of every thread
+    uint64_t voluntarySwitches;
+    uint64_t involuntarySwitches;
+    uint64_t reactorWakeups;
+    size_t rssKib;
+    size_t fds;
+
+    static ResourceUsage Sample();
+};
+
+} // namespace inputhook
+
+#endif // INPUTHOOK_RESOURCE_MONITOR_H
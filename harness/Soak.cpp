@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputHookSoak"
+
+// #define LOG_NDEBUG 0
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <android/log.h>
+#include <linux/input.h>
+#include <log/log.h>
+#include "Allocations.h"
+#include "Config.h"
+#include "ResourceMonitor.h"
+#include "Soak.h"
+
+namespace vendor {
+namespace nvidia {
+namespace hardware {
+namespace shieldtech {
+namespace inputflinger {
+namespace V2_0 {
+namespace implementation {
+
+namespace soak {
+    constexpr int32_t IdBase{10000}; //!< Well clear of the IDs InputFlinger hands out
+    constexpr int32_t IdRange{1000};
+    constexpr uint32_t FramesPerCycle{32};
+    constexpr auto FrameTime{std::chrono::milliseconds{8}}; //!< The simulated time each frame stands for, a 125Hz controller
+    constexpr uint32_t WarmupCycles{20}; //!< Cycles before the baseline is taken so one-off allocations don't count as growth
+    constexpr auto IdleTime{std::chrono::seconds{2}}; //!< How long wakeups are measured for once every device is gone
+}
+
+//! Limits read from the budget file, a missing entry isn't checked
+struct SoakBudget {
+    double cpuUsPerCycle{-1};
+    double voluntarySwitchesPerCycle{-1};
+    double involuntarySwitchesPerCycle{-1};
+    double idleWakeupsPerSecond{-1};
+    double rssGrowthKib{-1};
+    double fdGrowth{-1};
+    double hotPathAllocations{-1};
+
+    bool Load(const char *path) {
+        return config::ForEachLine(path, [&](const std::vector<std::string_view> &tokens, int lineNo) {
+            float value{};
+            if (tokens.size() != 2 || !config::ParseFloat(tokens[1], value)) {
+                ALOGW("%s:%d: Malformed budget", path, lineNo);
+                return;
+            }
+
+            auto name{tokens[0]};
+            if (name == "cpu_us_per_cycle")
+                cpuUsPerCycle = value;
+            else if (name == "voluntary_switches_per_cycle")
+                voluntarySwitchesPerCycle = value;
+            else if (name == "involuntary_switches_per_cycle")
+                involuntarySwitchesPerCycle = value;
+            else if (name == "idle_wakeups_per_second")
+                idleWakeupsPerSecond = value;
+            else if (name == "rss_growth_kib")
+                rssGrowthKib = value;
+            else if (name == "fd_growth")
+                fdGrowth = value;
+            else if (name == "hot_path_allocations")
+                hotPathAllocations = value;
+            else
+                ALOGW("%s:%d: Unknown budget", path, lineNo);
+        });
+    }
+};
+
+static void Cycle(InputHook &hook, std::mt19937 &random, uint32_t cycle) {
+    std::uniform_real_distribution<float> position{-1.0f, 1.0f};
+    auto ignore{[](Response, int32_t, const HidlInputEvent &) {}};
+    auto event{[&](int32_t id, uint16_t type, uint16_t code, int32_t value) {
+        HidlInputEvent iev{};
+        iev.when = static_cast<int64_t>(metrics::NowNs());
+        iev.type = type;
+        iev.code = code;
+        iev.value = value;
+        hook.filterEvent(iev, id, ignore);
+    }};
+
+    int32_t gamepad{soak::IdBase + static_cast<int32_t>((cycle * 2) % soak::IdRange)};
+    int32_t joycon{gamepad + 1};
+    hook.addDevice(gamepad, 0x057e, 0x2009, RightStickAxes::RxRy, nullptr);
+    hook.addDevice(joycon, 0x057e, 0x2006, RightStickAxes::None, nullptr);
+
+    for (uint32_t frame{}; frame < soak::FramesPerCycle; frame++) {
+        AnalogCoords pc{};
+        pc.rsX = position(random);
+        pc.rsY = position(random);
+        event(gamepad, EV_ABS, ABS_RX, static_cast<int32_t>(pc.rsX * 32767));
+        event(gamepad, EV_ABS, ABS_RY, static_cast<int32_t>(pc.rsY * 32767));
+        event(gamepad, EV_SYN, SYN_REPORT, 0);
+        hook.notifyMotionState(gamepad, pc, frame % 7 == 0);
+
+        if (frame % 8 == 4) {
+            event(gamepad, EV_ABS, ABS_RZ, 255);
+            event(gamepad, EV_ABS, ABS_RZ, 0);
+        }
+
+        // RsMouse is toggled off and back on again every cycle
+        if (frame == soak::FramesPerCycle / 2 || frame == soak::FramesPerCycle - 1) {
+            event(gamepad, EV_KEY, BTN_Z, 1);
+            event(gamepad, EV_KEY, BTN_Z, 0);
+        }
+
+        event(joycon, EV_KEY, BTN_SOUTH, frame & 1);
+        event(joycon, EV_SYN, SYN_REPORT, 0);
+    }
+
+    hook.removeDevice(joycon);
+    hook.removeDevice(gamepad);
+}
+
+//! The heap allocations made on every path that mustn't allocate, always 0 unless counting
+static uint64_t HotPathAllocations() {
+    uint64_t allocations{};
+    for (size_t i{}; i < static_cast<size_t>(alloc::Path::Count); i++)
+        allocations += alloc::Allocations(static_cast<alloc::Path>(i));
+    return allocations;
+}
+
+static bool Check(int out, const char *name, double value, double budget) {
+    bool passed{budget < 0 || value <= budget};
+    if (budget < 0)
+        dprintf(out, "  %-32s %12.2f\n", name, value);
+    else
+        dprintf(out, "  %-32s %12.2f / %-12.2f %s\n", name, value, budget, passed ? "PASS" : "FAIL");
+    return passed;
+}
+
+bool RunSoak(InputHook &hook, uint32_t seconds, const char *budgetPath, int out) {
+    SoakBudget budget;
+    if (!budget.Load(budgetPath)) {
+        dprintf(out, "Failed to read soak budget: %s\n", budgetPath);
+        return false;
+    }
+
+    std::mt19937 random{0};
+    uint32_t cycle{};
+    for (; cycle < soak::WarmupCycles; cycle++)
+        Cycle(hook, random, cycle);
+
+    auto devices{hook.mDeviceDb.size()};
+    auto allocations{HotPathAllocations()};
+    auto start{ResourceUsage::Sample()};
+    auto end{start.time + static_cast<uint64_t>(seconds) * 1000000000};
+    uint32_t cycles{};
+    while (metrics::NowNs() < end) {
+        Cycle(hook, random, cycle++);
+        cycles++;
+    }
+    auto finish{ResourceUsage::Sample()};
+
+    std::this_thread::sleep_for(soak::IdleTime);
+    auto idle{ResourceUsage::Sample()};
+
+    double elapsed{static_cast<double>(finish.time - start.time) / 1e9};
+    double idleElapsed{static_cast<double>(idle.time - finish.time) / 1e9};
+    auto simulated{std::chrono::duration_cast<std::chrono::minutes>(soak::FrameTime * soak::FramesPerCycle * cycles)};
+    dprintf(out, "Soaked %u cycles in %.1fs (%lld minutes of simulated controller time)\n", cycles, elapsed, static_cast<long long>(simulated.count()));
+
+    bool passed{true};
+    passed &= Check(out, "cpu_us_per_cycle", static_cast<double>(finish.cpuNs - start.cpuNs) / 1000.0 / std::max(cycles, 1U), budget.cpuUsPerCycle);
+    passed &= Check(out, "voluntary_switches_per_cycle", static_cast<double>(finish.voluntarySwitches - start.voluntarySwitches) / std::max(cycles, 1U), budget.voluntarySwitchesPerCycle);
+    passed &= Check(out, "involuntary_switches_per_cycle", static_cast<double>(finish.involuntarySwitches - start.involuntarySwitches) / std::max(cycles, 1U), budget.involuntarySwitchesPerCycle);
+    passed &= Check(out, "idle_wakeups_per_second", static_cast<double>(idle.reactorWakeups - finish.reactorWakeups) / idleElapsed, budget.idleWakeupsPerSecond);
+    passed &= Check(out, "rss_growth_kib", static_cast<double>(idle.rssKib) - static_cast<double>(start.rssKib), budget.rssGrowthKib);
+    passed &= Check(out, "fd_growth", static_cast<double>(idle.fds) - static_cast<double>(start.fds), budget.fdGrowth);
+    if (alloc::Counting)
+        passed &= Check(out, "hot_path_allocations", static_cast<double>(HotPathAllocations() - allocations), budget.hotPathAllocations);
+    passed &= Check(out, "device_db_growth", static_cast<double>(hook.mDeviceDb.size()) - static_cast<double>(devices), 0);
+
+    dprintf(out, "Soak %s\n", passed ? "passed" : "FAILED");
+    return passed;
+}
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace inputflinger
+}  // namespace shieldtech
+}  // namespace hardware
+}  // namespace nvidia
+}  // namespace vendor
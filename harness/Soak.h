@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VENDOR_NVIDIA_HARDWARE_SHIELDTECH_INPUTFLINGER_V2_0_SOAK_H
+#define VENDOR_NVIDIA_HARDWARE_SHIELDTECH_INPUTFLINGER_V2_0_SOAK_H
+
+#include "InputHook.h"
+
+namespace vendor {
+namespace nvidia {
+namespace hardware {
+namespace shieldtech {
+namespace inputflinger {
+namespace V2_0 {
+namespace implementation {
+
+/**
+ * @brief Drives synthetic controller churn, stick motion, clicks and RsMouse toggling through the hook for |seconds| and checks the resources used against a budget
+ * @note Each cycle plugs in a gamepad and a Joy-Con, so an RsMouse device is created and destroyed every time, which is a pipe rather than a uinput device in the loopback build the harness uses
+ * @return If every budget was met
+ */
+bool RunSoak(InputHook &hook, uint32_t seconds, const char *budgetPath, int out);
+
+}  // namespace implementation
+}  // namespace V2_0
+}  // namespace inputflinger
+}  // namespace shieldtech
+}  // namespace hardware
+}  // namespace nvidia
+}  // namespace vendor
+
+#endif  // VENDOR_NVIDIA_HARDWARE_SHIELDTECH_INPUTFLINGER_V2_0_SOAK_H
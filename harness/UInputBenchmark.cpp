@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "UInputBenchmark.h"
+
+#include <linux/input.h>
+#include <stdio.h>
+
+#include <type_traits>
+
+#include "EvdevInjector.h"
+#include "Metrics.h"
+
+namespace inputhook {
+
+namespace {
+
+template <typename Backend>
+void BenchmarkBackend(int fd, const char* name) {
+  constexpr int kFrames = 10000;
+  constexpr int kBatch = 8;
+
+  // Without buttons InputFlinger doesn't take this for a pointer, and the
+  // motion cancels out regardless.
+  BasicEvdevInjector<Backend> injector;
+  injector.ConfigureBegin("Input Hook Benchmark", BUS_VIRTUAL, 0, 0, 1);
+  injector.ConfigureRel(REL_X);
+  injector.ConfigureRel(REL_Y);
+  if (const int status = injector.ConfigureEnd()) {
+    dprintf(fd, "  %-12s unavailable (%d)\n", name, status);
+    return;
+  }
+  bool fallback = false;
+  if constexpr (std::is_same_v<Backend, IoUringUInput>) {
+    fallback = !injector.GetUInput().UsingRing();
+  }
+
+  uint64_t start = metrics::NowNs();
+  for (int i = 0; i < kFrames; ++i) {
+    injector.SendRel(REL_X, i % 2 ? -1 : 1);
+    injector.SendRel(REL_Y, i % 2 ? 1 : -1);
+    injector.SendSynReport();
+  }
+  const uint64_t single = metrics::NowNs() - start;
+
+  start = metrics::NowNs();
+  for (int i = 0; i < kFrames; i += kBatch) {
+    injector.BeginBatch();
+    for (int j = 0; j < kBatch; ++j) {
+      injector.SendRel(REL_X, j % 2 ? -1 : 1);
+      injector.SendRel(REL_Y, j % 2 ? 1 : -1);
+      injector.SendSynReport();
+    }
+    injector.EndBatch();
+  }
+  const uint64_t batched = metrics::NowNs() - start;
+
+  dprintf(fd, "  %-12s %12.1f %12.1f%s\n", name,
+          static_cast<double>(single) / kFrames,
+          static_cast<double>(batched) / kFrames,
+          fallback ? "  (fell back to write())" : "");
+}
+
+}  // namespace
+
+void BenchmarkUInputBackends(int fd) {
+  dprintf(fd, "uinput backends (ns per frame, submission only):\n");
+  dprintf(fd, "  %-12s %12s %12s\n", "", "single", "batched");
+  BenchmarkBackend<SyscallUInput>(fd, "syscall");
+  BenchmarkBackend<IoUringUInput>(fd, "io_uring");
+  BenchmarkBackend<LoopbackUInput>(fd, "loopback");
+}
+
+}  // namespace inputhook
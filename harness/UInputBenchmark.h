@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_UINPUT_BENCHMARK_H
+#define INPUTHOOK_UINPUT_BENCHMARK_H
+
+namespace inputhook {
+
+// Times frames sent through each uinput backend on a throwaway device.
+void BenchmarkUInputBackends(int fd);
+
+}  // namespace inputhook
+
+#endif  // INPUTHOOK_UINPUT_BENCHMARK_H
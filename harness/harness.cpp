@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputHookHarness"
+
+// #define LOG_NDEBUG 0
+
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+#include <android/log.h>
+#include "Config.h"
+#include "CursorKernel.h"
+#include "InputHook.h"
+#include "Metrics.h"
+#include "Replay.h"
+#include "Soak.h"
+#include "UInputBenchmark.h"
+
+using android::sp;
+
+using vendor::nvidia::hardware::shieldtech::inputflinger::V2_0::implementation::InputHook;
+using vendor::nvidia::hardware::shieldtech::inputflinger::V2_0::implementation::ReplayTrace;
+using vendor::nvidia::hardware::shieldtech::inputflinger::V2_0::implementation::RunSoak;
+
+//! Provided by the compiler runtime only when built with -fprofile-generate
+extern "C" int __llvm_profile_write_file(void) __attribute__((weak));
+
+static int Usage(const char *name) {
+    fprintf(stderr, "usage: %s soak <seconds> <budget file>\n", name);
+    fprintf(stderr, "       %s replay <trace>...\n", name);
+    fprintf(stderr, "       %s bench\n", name);
+    return 2;
+}
+
+int main(int argc, char **argv) {
+    inputhook::metrics::registry.serviceStart = inputhook::metrics::NowNs();
+
+    if (argc < 2)
+        return Usage(argv[0]);
+
+    std::string command{argv[1]};
+    if (command == "bench" && argc == 2) {
+        bool matched{inputhook::cursor::Benchmark(STDOUT_FILENO)};
+        inputhook::BenchmarkUInputBackends(STDOUT_FILENO);
+        return matched ? 0 : 1;
+    }
+
+    // Neither registered as a service nor restored from /dev/inputhook/state, so it can run next to the real service
+    sp<InputHook> hook{new InputHook()};
+    hook->registerDevices();
+    inputhook::metrics::registry.serviceReady = inputhook::metrics::NowNs();
+
+    if (command == "soak" && argc == 4) {
+        int32_t seconds{};
+        if (!inputhook::config::ParseInt(argv[2], seconds) || seconds <= 0) {
+            fprintf(stderr, "Invalid soak duration: %s\n", argv[2]);
+            return 2;
+        }
+        return RunSoak(*hook, static_cast<uint32_t>(seconds), argv[3], STDOUT_FILENO) ? 0 : 1;
+    }
+
+    if (command == "replay" && argc >= 3) {
+        bool replayed{true};
+        for (int i{2}; i < argc; i++)
+            replayed &= ReplayTrace(*hook, argv[i], STDOUT_FILENO);
+
+        // Written here rather than at exit so a failure to write shows up next to the replay results
+        if (__llvm_profile_write_file)
+            dprintf(STDOUT_FILENO, "Wrote profile: %s\n", __llvm_profile_write_file() == 0 ? "ok" : "failed");
+        return replayed ? 0 : 1;
+    }
+
+    return Usage(argv[0]);
+}
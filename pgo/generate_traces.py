@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2021 The LineageOS Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Generates the replay traces used to train the PGO profile, see harness/Replay.h for the format."""
+
+import math
+import os
+import random
+
+EV_SYN, EV_KEY, EV_ABS = 0x00, 0x01, 0x03
+SYN_REPORT = 0
+BTN_SOUTH, BTN_EAST, BTN_NORTH, BTN_WEST = 0x130, 0x131, 0x133, 0x134
+BTN_TL, BTN_TR, BTN_Z = 0x136, 0x137, 0x135
+ABS_X, ABS_Y, ABS_RX, ABS_RY, ABS_RZ = 0x00, 0x01, 0x03, 0x04, 0x05
+
+PRO_CONTROLLER = (0x057e, 0x2009)
+JOYCON_LEFT = (0x057e, 0x2006)
+
+FRAME_MS = 8  # 125Hz, what Switch controllers report at over bluetooth
+
+
+class Trace:
+    def __init__(self, seed):
+        self.lines = []
+        self.random = random.Random(seed)
+
+    def add(self, id, device, rightstick):
+        self.lines.append(f"add {id} {device[0]:#06x} {device[1]:#06x} {int(rightstick)}")
+
+    def remove(self, id):
+        self.lines.append(f"remove {id}")
+
+    def event(self, id, type, code, value):
+        self.lines.append(f"event {id} {type:#x} {code:#x} {value}")
+
+    def sync(self, id):
+        self.event(id, EV_SYN, SYN_REPORT, 0)
+
+    def motion(self, id, x, y, handled=False):
+        self.lines.append(f"motion {id} {x:.4f} {y:.4f} {int(handled)}")
+
+    def wait(self, ms):
+        self.lines.append(f"wait {ms}")
+
+    def press(self, id, code):
+        self.event(id, EV_KEY, code, 1)
+        self.sync(id)
+        self.event(id, EV_KEY, code, 0)
+        self.sync(id)
+
+    def stick_sweep(self, id, frames, click_every=0):
+        """Moves the right stick around in a circle like a user navigating with RsMouse, optionally clicking R2."""
+        for frame in range(frames):
+            angle = frame / frames * 2 * math.pi
+            magnitude = 0.3 + 0.7 * self.random.random()
+            x, y = magnitude * math.cos(angle), magnitude * math.sin(angle)
+            self.event(id, EV_ABS, ABS_RX, int(x * 32767))
+            self.event(id, EV_ABS, ABS_RY, int(y * 32767))
+            self.sync(id)
+            self.motion(id, x, y)
+            if click_every and frame % click_every == 0:
+                self.event(id, EV_ABS, ABS_RZ, 255)
+                self.sync(id)
+                self.event(id, EV_ABS, ABS_RZ, 0)
+                self.sync(id)
+            self.wait(FRAME_MS)
+
+    def gameplay(self, id, frames):
+        """Left stick and face buttons with the app handling motion, so RsMouse stays out of the way."""
+        buttons = [BTN_SOUTH, BTN_EAST, BTN_NORTH, BTN_WEST, BTN_TL, BTN_TR]
+        for frame in range(frames):
+            self.event(id, EV_ABS, ABS_X, self.random.randint(-32767, 32767))
+            self.event(id, EV_ABS, ABS_Y, self.random.randint(-32767, 32767))
+            self.sync(id)
+            self.motion(id, 0.0, 0.0, handled=True)
+            if self.random.random() < 0.2:
+                self.press(id, self.random.choice(buttons))
+            self.wait(FRAME_MS)
+
+    def write(self, path):
+        with open(path, "w") as f:
+            f.write("# Generated by pgo/generate_traces.py, do not edit\n")
+            f.write("\n".join(self.lines) + "\n")
+
+
+def desktop():
+    trace = Trace(1)
+    trace.add(1000, PRO_CONTROLLER, True)
+    trace.stick_sweep(1000, 600, click_every=40)
+    trace.press(1000, BTN_Z)
+    trace.stick_sweep(1000, 100)
+    trace.press(1000, BTN_Z)
+    trace.stick_sweep(1000, 300, click_every=25)
+    trace.remove(1000)
+    return trace
+
+
+def gameplay():
+    trace = Trace(2)
+    trace.add(1000, PRO_CONTROLLER, True)
+    trace.gameplay(1000, 1200)
+    trace.remove(1000)
+    return trace
+
+
+def hotplug():
+    trace = Trace(3)
+    for cycle in range(50):
+        trace.add(1000 + cycle, PRO_CONTROLLER, True)
+        trace.add(2000 + cycle, JOYCON_LEFT, False)
+        trace.stick_sweep(1000 + cycle, 10, click_every=5)
+        trace.gameplay(2000 + cycle, 10)
+        trace.remove(2000 + cycle)
+        trace.remove(1000 + cycle)
+    return trace
+
+
+if __name__ == "__main__":
+    out = os.path.join(os.path.dirname(os.path.abspath(__file__)), "traces")
+    os.makedirs(out, exist_ok=True)
+    for name, build in [("desktop", desktop), ("gameplay", gameplay), ("hotplug", hotplug)]:
+        build().write(os.path.join(out, f"{name}.trace"))
@@ -22,6 +22,7 @@
 #include <android/log.h>
 #include <hidl/HidlTransportSupport.h>
 #include "InputHook.h"
+#include "Metrics.h"
 
 using android::sp;
 using android::status_t;
@@ -35,6 +36,7 @@ using android::hardware::joinRpcThreadpool;
 using vendor::nvidia::hardware::shieldtech::inputflinger::V2_0::implementation::InputHook;
 
 int main() {
+    inputhook::metrics::registry.serviceStart = inputhook::metrics::NowNs();
 
     status_t status;
     android::sp<InputHook> service = nullptr;
@@ -48,6 +50,9 @@ int main() {
         goto shutdown;
     }
 
+    // Only the service picks up where a previous instance left off, inputhook_harness starts from nothing
+    service->restoreSnapshot();
+
     configureRpcThreadpool(1, true /*callerWillJoin*/);
 
     status = service->registerAsSystemService();
@@ -56,6 +61,7 @@ int main() {
         goto shutdown;
     }
 
+    inputhook::metrics::registry.serviceReady = inputhook::metrics::NowNs();
     ALOGI("Input Hook is ready");
     joinRpcThreadpool();
     //Should not pass this line
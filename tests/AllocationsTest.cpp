@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <gtest/gtest.h>
+#include "Allocations.h"
+
+namespace inputhook {
+namespace {
+
+std::unique_ptr<int> sink;
+
+//! Allocates through a global so the compiler can't elide the allocation, which it may do for a new/delete pair it can see
+void Allocate() {
+    sink = std::make_unique<int>(1);
+}
+
+class AllocationsTest : public testing::Test {
+  protected:
+    void SetUp() override {
+        if (!alloc::Counting)
+            GTEST_SKIP() << "Needs INPUTHOOK_ALLOC_COUNTING";
+    }
+
+    void TearDown() override {
+        alloc::SetStrict(false);
+        sink.reset();
+    }
+};
+
+TEST_F(AllocationsTest, CountsThreadAllocations) {
+    auto before{alloc::ThreadCount()};
+    Allocate();
+    EXPECT_EQ(alloc::ThreadCount(), before + 1);
+}
+
+TEST_F(AllocationsTest, EmptyScopeRecordsNothing) {
+    auto before{alloc::Allocations(alloc::Path::Tick)};
+    {
+        alloc::Scope scope{alloc::Path::Tick};
+    }
+    EXPECT_EQ(alloc::Allocations(alloc::Path::Tick), before);
+}
+
+TEST_F(AllocationsTest, ScopeRecordsAllocations) {
+    auto before{alloc::Allocations(alloc::Path::Tick)};
+    {
+        alloc::Scope scope{alloc::Path::Tick};
+        Allocate();
+        Allocate();
+    }
+    EXPECT_EQ(alloc::Allocations(alloc::Path::Tick), before + 2);
+}
+
+TEST_F(AllocationsTest, StrictModeAbortsOnAllocation) {
+    alloc::SetStrict(true);
+    {
+        alloc::Scope scope{alloc::Path::FilterEvent}; // Without allocations strict mode doesn't trip
+    }
+
+    EXPECT_DEATH({
+        alloc::Scope scope{alloc::Path::FilterEvent};
+        Allocate();
+    }, "");
+}
+
+} // namespace
+} // namespace inputhook
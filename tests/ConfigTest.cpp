@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "Config.h"
+
+namespace inputhook {
+namespace {
+
+TEST(ConfigTest, ParseIntDecimal) {
+    int32_t value{};
+    EXPECT_TRUE(config::ParseInt("304", value));
+    EXPECT_EQ(value, 304);
+    EXPECT_TRUE(config::ParseInt("-32767", value));
+    EXPECT_EQ(value, -32767);
+    EXPECT_TRUE(config::ParseInt("+5", value));
+    EXPECT_EQ(value, 5);
+}
+
+TEST(ConfigTest, ParseIntLeadingZeroIsDecimal) {
+    int32_t value{};
+    EXPECT_TRUE(config::ParseInt("0010", value));
+    EXPECT_EQ(value, 10);
+    EXPECT_TRUE(config::ParseInt("09", value));
+    EXPECT_EQ(value, 9);
+    EXPECT_TRUE(config::ParseInt("0", value));
+    EXPECT_EQ(value, 0);
+}
+
+TEST(ConfigTest, ParseIntHexNeedsPrefix) {
+    int32_t value{};
+    EXPECT_TRUE(config::ParseInt("0x130", value));
+    EXPECT_EQ(value, 0x130);
+    EXPECT_TRUE(config::ParseInt("0X0955", value));
+    EXPECT_EQ(value, 0x955);
+    EXPECT_TRUE(config::ParseInt("-0x10", value));
+    EXPECT_EQ(value, -16);
+    EXPECT_FALSE(config::ParseInt("130a", value));
+    EXPECT_FALSE(config::ParseInt("ff", value));
+}
+
+TEST(ConfigTest, ParseIntRejectsInvalid) {
+    int32_t value{42};
+    EXPECT_FALSE(config::ParseInt("", value));
+    EXPECT_FALSE(config::ParseInt("0x", value));
+    EXPECT_FALSE(config::ParseInt("-", value));
+    EXPECT_FALSE(config::ParseInt("12 ", value));
+    EXPECT_FALSE(config::ParseInt("2147483648", value));
+    EXPECT_FALSE(config::ParseInt("-0x80000001", value));
+    EXPECT_EQ(value, 42);
+}
+
+} // namespace
+} // namespace inputhook
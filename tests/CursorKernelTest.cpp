@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <gtest/gtest.h>
+#include "CursorKernel.h"
+
+namespace inputhook {
+namespace cursor {
+namespace {
+
+constexpr Params Default{.deadzone = 0.1f, .power = 3.0f, .speed = 27.0f};
+
+//! Runs the same ticks through Update and UpdateReference and expects the whole state to match after every one
+class CursorKernelTest : public testing::Test {
+  protected:
+    Sources mVector{}, mReference{};
+
+    void Tick(const float (&x)[MaxSources], const float (&y)[MaxSources], const Params &params) {
+        std::memcpy(mVector.x, x, sizeof(x));
+        std::memcpy(mVector.y, y, sizeof(y));
+        std::memcpy(mReference.x, x, sizeof(x));
+        std::memcpy(mReference.y, y, sizeof(y));
+        Update(mVector, params);
+        UpdateReference(mReference, params);
+
+        for (size_t i{}; i < MaxSources; i++) {
+            EXPECT_EQ(mVector.changeX[i], mReference.changeX[i]) << "slot " << i << " x " << x[i] << " y " << y[i];
+            EXPECT_EQ(mVector.changeY[i], mReference.changeY[i]) << "slot " << i << " x " << x[i] << " y " << y[i];
+        }
+        ASSERT_EQ(std::memcmp(&mVector, &mReference, sizeof(Sources)), 0) << "power " << params.power;
+    }
+};
+
+TEST_F(CursorKernelTest, MatchesOnRandomInput) {
+    std::mt19937 random{0};
+    std::uniform_real_distribution<float> position{-1.0f, 1.0f};
+    for (float power : {1.0f, 2.0f, 2.5f, 3.0f, 0.7f}) {
+        Params params{Default};
+        params.power = power;
+        for (int tick{}; tick < 20000; tick++) {
+            float x[MaxSources], y[MaxSources];
+            for (size_t i{}; i < MaxSources; i++) {
+                // Some slots hover around the deadzone like a resting stick
+                float scale{i % 3 == 0 ? 0.15f : 1.0f};
+                x[i] = position(random) * scale;
+                y[i] = position(random) * scale;
+            }
+            ASSERT_NO_FATAL_FAILURE(Tick(x, y, params));
+        }
+    }
+}
+
+TEST_F(CursorKernelTest, MatchesOnEdgeInput) {
+    const float deadzone{Default.deadzone};
+    const std::vector<float> edges{
+        0.0f, -0.0f, 1.0f, -1.0f, 0.5f, -0.5f,
+        deadzone, -deadzone,
+        std::nextafter(deadzone, 0.0f), -std::nextafter(deadzone, 0.0f),
+        std::nextafter(deadzone, 1.0f), -std::nextafter(deadzone, 1.0f),
+        1.0f - deadzone, std::nextafter(1.0f, 0.0f), -std::nextafter(1.0f, 0.0f),
+    };
+
+    for (float power : {3.0f, 2.5f}) {
+        Params params{Default};
+        params.power = power;
+        // Every pair of edge values in every slot, shifted so each slot sees a different pair on each tick
+        for (size_t a{}; a < edges.size(); a++) {
+            for (size_t b{}; b < edges.size(); b++) {
+                float x[MaxSources], y[MaxSources];
+                for (size_t i{}; i < MaxSources; i++) {
+                    x[i] = edges[(a + i) % edges.size()];
+                    y[i] = edges[(b + i * 3) % edges.size()];
+                }
+                ASSERT_NO_FATAL_FAILURE(Tick(x, y, params));
+            }
+        }
+    }
+}
+
+TEST_F(CursorKernelTest, MatchesWithPartlyFilledGroups) {
+    // The first |used| slots are active and the rest idle at 0, covering a partly filled and an empty group of four
+    std::mt19937 random{1};
+    std::uniform_real_distribution<float> position{-1.0f, 1.0f};
+    for (size_t used{1}; used <= MaxSources; used++) {
+        for (int tick{}; tick < 500; tick++) {
+            float x[MaxSources]{}, y[MaxSources]{};
+            for (size_t i{}; i < used; i++) {
+                x[i] = position(random);
+                y[i] = position(random);
+            }
+            ASSERT_NO_FATAL_FAILURE(Tick(x, y, Default));
+        }
+        for (size_t i{used}; i < MaxSources; i++) {
+            EXPECT_EQ(mVector.changeX[i], 0);
+            EXPECT_EQ(mVector.changeY[i], 0);
+        }
+    }
+}
+
+TEST_F(CursorKernelTest, BenchmarkReportsNoMismatch) {
+    EXPECT_TRUE(Benchmark(-1)); // dprintf to an invalid fd just fails
+}
+
+}  // namespace
+}  // namespace cursor
+}  // namespace inputhook
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ostream>
+#include <vector>
+#include <gtest/gtest.h>
+#include "EvdevInjectorImpl.h"
+#include "MockUInput.h"
+
+namespace inputhook {
+
+template class BasicEvdevInjector<MockUInput>;
+
+namespace {
+
+using MockInjector = BasicEvdevInjector<MockUInput>;
+
+//! The type, code and value of an event, what the tests compare the written events against
+struct Event {
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+
+    bool operator==(const Event &other) const {
+        return type == other.type && code == other.code && value == other.value;
+    }
+};
+
+std::ostream &operator<<(std::ostream &out, const Event &event) {
+    return out << "{" << event.type << ", " << event.code << ", " << event.value << "}";
+}
+
+std::vector<Event> Events(const std::vector<input_event> &written) {
+    std::vector<Event> events;
+    for (auto &event : written)
+        events.push_back({event.type, event.code, event.value});
+    return events;
+}
+
+class EvdevInjectorTest : public testing::Test {
+  protected:
+    MockInjector mInjector;
+
+    MockUInput &UInput() {
+        return mInjector.GetUInput();
+    }
+
+    void SetUp() override {
+        ASSERT_EQ(mInjector.ConfigureBegin("Test", BUS_VIRTUAL, 0, 0, 1), 0);
+        ASSERT_EQ(mInjector.ConfigureRel(REL_X), 0);
+        ASSERT_EQ(mInjector.ConfigureRel(REL_Y), 0);
+        ASSERT_EQ(mInjector.ConfigureKey(BTN_LEFT), 0);
+        ASSERT_EQ(mInjector.ConfigureEnd(), 0);
+    }
+};
+
+TEST(EvdevInjectorSequencingTest, SendBeforeConfigureEndFails) {
+    MockInjector injector;
+    EXPECT_EQ(injector.SendSynReport(), MockInjector::ERROR_SEQUENCING);
+    EXPECT_TRUE(injector.GetUInput().writes.empty());
+}
+
+TEST_F(EvdevInjectorTest, ConfigureCreatesDevice) {
+    EXPECT_TRUE(UInput().open);
+    EXPECT_EQ(UInput().settings_writes, 1);
+    ASSERT_FALSE(UInput().ioctls.empty());
+    EXPECT_EQ(UInput().ioctls.back(), static_cast<int>(UI_DEV_CREATE));
+    EXPECT_TRUE(UInput().writes.empty());
+}
+
+TEST_F(EvdevInjectorTest, FrameIsWrittenOnSynReport) {
+    EXPECT_EQ(mInjector.SendRel(REL_X, 3), 0);
+    EXPECT_EQ(mInjector.SendRel(REL_Y, -2), 0);
+    EXPECT_TRUE(UInput().writes.empty()) << "Events were written before their SYN_REPORT";
+
+    EXPECT_EQ(mInjector.SendSynReport(), 0);
+    ASSERT_EQ(UInput().writes.size(), 1u);
+    EXPECT_EQ(Events(UInput().writes[0]), (std::vector<Event>{{EV_REL, REL_X, 3}, {EV_REL, REL_Y, -2}, {EV_SYN, SYN_REPORT, 0}}));
+}
+
+TEST_F(EvdevInjectorTest, EveryFrameIsOneWrite) {
+    mInjector.SendKey(BTN_LEFT, MockInjector::KEY_PRESS);
+    mInjector.SendSynReport();
+    mInjector.SendKey(BTN_LEFT, MockInjector::KEY_RELEASE);
+    mInjector.SendSynReport();
+
+    ASSERT_EQ(UInput().writes.size(), 2u);
+    EXPECT_EQ(Events(UInput().writes[0]), (std::vector<Event>{{EV_KEY, BTN_LEFT, 1}, {EV_SYN, SYN_REPORT, 0}}));
+    EXPECT_EQ(Events(UInput().writes[1]), (std::vector<Event>{{EV_KEY, BTN_LEFT, 0}, {EV_SYN, SYN_REPORT, 0}}));
+}
+
+TEST_F(EvdevInjectorTest, BatchHoldsFramesUntilTheOutermostEnd) {
+    mInjector.BeginBatch();
+    mInjector.SendRel(REL_X, 1);
+    mInjector.SendSynReport();
+    mInjector.BeginBatch();
+    mInjector.SendRel(REL_Y, 1);
+    mInjector.SendSynReport();
+    EXPECT_EQ(mInjector.EndBatch(), 0);
+    EXPECT_TRUE(UInput().writes.empty()) << "A nested EndBatch flushed";
+
+    EXPECT_EQ(mInjector.EndBatch(), 0);
+    ASSERT_EQ(UInput().writes.size(), 1u);
+    EXPECT_EQ(Events(UInput().writes[0]), (std::vector<Event>{{EV_REL, REL_X, 1}, {EV_SYN, SYN_REPORT, 0}, {EV_REL, REL_Y, 1}, {EV_SYN, SYN_REPORT, 0}}));
+
+    // Unbalanced ends don't write anything, and frames flush on SYN_REPORT again
+    EXPECT_EQ(mInjector.EndBatch(), 0);
+    EXPECT_EQ(UInput().writes.size(), 1u);
+    mInjector.SendRel(REL_X, 2);
+    mInjector.SendSynReport();
+    EXPECT_EQ(UInput().writes.size(), 2u);
+}
+
+TEST_F(EvdevInjectorTest, FullQueueIsFlushedBeforeTheNextEvent) {
+    constexpr size_t Extra{3};
+    for (size_t i{}; i < MockInjector::kMaxPendingEvents + Extra; i++)
+        EXPECT_EQ(mInjector.SendRel(REL_X, static_cast<int32_t>(i)), 0);
+
+    // The queue was written out whole when it ran out of room, the rest wait for the SYN_REPORT
+    ASSERT_EQ(UInput().writes.size(), 1u);
+    ASSERT_EQ(UInput().writes[0].size(), MockInjector::kMaxPendingEvents);
+    EXPECT_EQ(UInput().writes[0].front().value, 0);
+    EXPECT_EQ(UInput().writes[0].back().value, static_cast<int32_t>(MockInjector::kMaxPendingEvents - 1));
+
+    mInjector.SendSynReport();
+    ASSERT_EQ(UInput().writes.size(), 2u);
+    ASSERT_EQ(UInput().writes[1].size(), Extra + 1);
+    EXPECT_EQ(UInput().writes[1].front().value, static_cast<int32_t>(MockInjector::kMaxPendingEvents));
+    EXPECT_EQ(Events(UInput().writes[1]).back(), (Event{EV_SYN, SYN_REPORT, 0}));
+}
+
+TEST_F(EvdevInjectorTest, WriteErrorIsSticky) {
+    UInput().write_error = EIO;
+    EXPECT_EQ(mInjector.SendSynReport(), EIO);
+    EXPECT_EQ(mInjector.GetError(), EIO);
+
+    UInput().write_error = 0;
+    mInjector.SendSynReport();
+    EXPECT_EQ(mInjector.GetError(), EIO);
+    mInjector.ResetError();
+    EXPECT_EQ(mInjector.GetError(), 0);
+}
+
+}  // namespace
+}  // namespace inputhook
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INPUTHOOK_TESTS_MOCK_UINPUT_H
+#define INPUTHOOK_TESTS_MOCK_UINPUT_H
+
+#include <linux/input.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <vector>
+
+namespace inputhook {
+
+// uinput backend for tests that records what EvdevInjector hands it instead of
+// creating a device. See EvdevInjector.h for the interface.
+//
+class MockUInput {
+ public:
+  static constexpr int kFds = 0;
+
+  int Open() {
+    open = true;
+    return 0;
+  }
+  int Close() {
+    open = false;
+    return 0;
+  }
+  int Write(const void* buf, size_t count) {
+    settings_writes++;
+    return 0;
+  }
+  int WriteEvents(const input_event* events, size_t count) {
+    writes.emplace_back(events, events + count);
+    return write_error;
+  }
+  int Read(void* buf, size_t count) { return EAGAIN; }
+  int IoctlVoid(int request) {
+    ioctls.push_back(request);
+    return 0;
+  }
+  int IoctlSetInt(int request, int value) {
+    ioctls.push_back(request);
+    return 0;
+  }
+  int IoctlPtr(int request, void* arg) {
+    ioctls.push_back(request);
+    return 0;
+  }
+  int GetFd() const { return -1; }
+
+  bool open = false;
+  int settings_writes = 0;     // Write() calls, the uinput_user_dev settings.
+  std::vector<int> ioctls;     // Every ioctl request in order.
+  int write_error = 0;         // Returned from WriteEvents().
+  // Every WriteEvents() call, each of which the kernel would get in one go.
+  std::vector<std::vector<input_event>> writes;
+};
+
+}  // namespace inputhook
+
+#endif  // INPUTHOOK_TESTS_MOCK_UINPUT_H
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <gtest/gtest.h>
+#include <linux/input.h>
+#include "Allocations.h"
+#include "EvdevInjector.h"
+#include "Remapper.h"
+
+namespace inputhook {
+namespace {
+
+constexpr int32_t DeviceId{7};
+constexpr int32_t OtherDeviceId{8};
+
+class RemapperTest : public testing::Test {
+  protected:
+    Remapper mRemapper;
+
+    void SetUp() override {
+        auto path{testing::TempDir() + "remap.conf"};
+        std::ofstream{path} << "device 0x0955 0x7214\n"
+                               "key 304 305\n"                       // BTN_A -> BTN_B
+                               "key_axis 0x136 2 0 255\n"            // BTN_TL -> ABS_Z, held at 0
+                               "axis_key 5 0x137 200 100\n"          // ABS_RZ -> BTN_TR, positive direction
+                               "axis_key 1 0x220 -20000 -10000\n";   // ABS_Y -> BTN_DPAD_UP, negative direction
+        mRemapper.LoadProfiles(path.c_str());
+        std::remove(path.c_str());
+
+        mRemapper.AddDevice(DeviceId, 0x0955, 0x7214);
+        mRemapper.AddDevice(OtherDeviceId, 0x045e, 0x028e);
+    }
+
+    static HidlInputEvent Event(int32_t type, int32_t code, int32_t value) {
+        HidlInputEvent iev{};
+        iev.type = type;
+        iev.code = code;
+        iev.value = value;
+        return iev;
+    }
+};
+
+TEST_F(RemapperTest, KeyToKey) {
+    auto iev{Event(EV_KEY, BTN_A, EvdevInjector::KEY_PRESS)};
+    EXPECT_EQ(mRemapper.FilterEvent(iev, DeviceId), Response::EVENT_DEFAULT);
+    EXPECT_EQ(iev.type, EV_KEY);
+    EXPECT_EQ(iev.code, BTN_B);
+    EXPECT_EQ(iev.value, EvdevInjector::KEY_PRESS);
+
+    iev = Event(EV_KEY, BTN_X, EvdevInjector::KEY_PRESS);
+    EXPECT_EQ(mRemapper.FilterEvent(iev, DeviceId), Response::EVENT_DEFAULT);
+    EXPECT_EQ(iev.code, BTN_X);
+}
+
+TEST_F(RemapperTest, DevicesWithoutProfileAreUntouched) {
+    auto iev{Event(EV_KEY, BTN_A, EvdevInjector::KEY_PRESS)};
+    EXPECT_EQ(mRemapper.FilterEvent(iev, OtherDeviceId), Response::EVENT_DEFAULT);
+    EXPECT_EQ(iev.code, BTN_A);
+
+    mRemapper.RemoveDevice(DeviceId);
+    EXPECT_EQ(mRemapper.FilterEvent(iev, DeviceId), Response::EVENT_DEFAULT);
+    EXPECT_EQ(iev.code, BTN_A);
+}
+
+TEST_F(RemapperTest, KeyToAxis) {
+    auto iev{Event(EV_KEY, BTN_TL, EvdevInjector::KEY_PRESS)};
+    EXPECT_EQ(mRemapper.FilterEvent(iev, DeviceId), Response::EVENT_DEFAULT);
+    EXPECT_EQ(iev.type, EV_ABS);
+    EXPECT_EQ(iev.code, ABS_Z);
+    EXPECT_EQ(iev.value, 0);
+
+    iev = Event(EV_KEY, BTN_TL, EvdevInjector::KEY_REPEAT);
+    EXPECT_EQ(mRemapper.FilterEvent(iev, DeviceId), Response::EVENT_SKIP);
+
+    iev = Event(EV_KEY, BTN_TL, EvdevInjector::KEY_RELEASE);
+    EXPECT_EQ(mRemapper.FilterEvent(iev, DeviceId), Response::EVENT_DEFAULT);
+    EXPECT_EQ(iev.type, EV_ABS);
+    EXPECT_EQ(iev.value, 255);
+}
+
+TEST_F(RemapperTest, AxisToKeyHysteresis) {
+    // Values between the thresholds never produce an edge, whichever way they're approached
+    const std::pair<int32_t, Response> steps[]{
+        {50, Response::EVENT_SKIP},
+        {150, Response::EVENT_SKIP},
+        {200, Response::EVENT_DEFAULT}, // Press
+        {255, Response::EVENT_SKIP},
+        {150, Response::EVENT_SKIP},
+        {199, Response::EVENT_SKIP},
+        {100, Response::EVENT_DEFAULT}, // Release
+        {150, Response::EVENT_SKIP},
+        {0, Response::EVENT_SKIP},
+        {230, Response::EVENT_DEFAULT}, // Press
+    };
+
+    bool pressed{};
+    for (auto &[value, response] : steps) {
+        auto iev{Event(EV_ABS, ABS_RZ, value)};
+        ASSERT_EQ(mRemapper.FilterEvent(iev, DeviceId), response) << "at " << value;
+        if (response == Response::EVENT_SKIP)
+            continue;
+
+        pressed = !pressed;
+        EXPECT_EQ(iev.type, EV_KEY);
+        EXPECT_EQ(iev.code, BTN_TR);
+        EXPECT_EQ(iev.value, pressed ? EvdevInjector::KEY_PRESS : EvdevInjector::KEY_RELEASE);
+    }
+}
+
+TEST_F(RemapperTest, AxisToKeyNegativeDirection) {
+    auto iev{Event(EV_ABS, ABS_Y, 20000)};
+    EXPECT_EQ(mRemapper.FilterEvent(iev, DeviceId), Response::EVENT_SKIP);
+
+    iev = Event(EV_ABS, ABS_Y, -25000);
+    EXPECT_EQ(mRemapper.FilterEvent(iev, DeviceId), Response::EVENT_DEFAULT);
+    EXPECT_EQ(iev.code, BTN_DPAD_UP);
+    EXPECT_EQ(iev.value, EvdevInjector::KEY_PRESS);
+
+    iev = Event(EV_ABS, ABS_Y, -15000);
+    EXPECT_EQ(mRemapper.FilterEvent(iev, DeviceId), Response::EVENT_SKIP);
+
+    iev = Event(EV_ABS, ABS_Y, -10000);
+    EXPECT_EQ(mRemapper.FilterEvent(iev, DeviceId), Response::EVENT_DEFAULT);
+    EXPECT_EQ(iev.value, EvdevInjector::KEY_RELEASE);
+
+    // Axes without a rule pass through
+    iev = Event(EV_ABS, ABS_X, 12345);
+    EXPECT_EQ(mRemapper.FilterEvent(iev, DeviceId), Response::EVENT_DEFAULT);
+    EXPECT_EQ(iev.type, EV_ABS);
+    EXPECT_EQ(iev.value, 12345);
+}
+
+TEST_F(RemapperTest, FilterEventDoesNotAllocate) {
+    if (!alloc::Counting)
+        GTEST_SKIP() << "Needs INPUTHOOK_ALLOC_COUNTING";
+
+    constexpr int Iterations{100000};
+    auto start{std::chrono::steady_clock::now()};
+    auto allocations{alloc::ThreadCount()};
+    for (int i{}; i < Iterations; i++) {
+        auto key{Event(EV_KEY, i % 2 ? BTN_A : BTN_TL, i % 3)};
+        mRemapper.FilterEvent(key, DeviceId);
+        auto axis{Event(EV_ABS, ABS_RZ, (i * 37) % 256)};
+        mRemapper.FilterEvent(axis, DeviceId);
+        auto other{Event(EV_KEY, BTN_A, 1)};
+        mRemapper.FilterEvent(other, OtherDeviceId);
+    }
+    allocations = alloc::ThreadCount() - allocations;
+    auto elapsed{std::chrono::steady_clock::now() - start};
+
+    EXPECT_EQ(allocations, 0u);
+    RecordProperty("ns_per_event", std::to_string(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / (Iterations * 3)));
+}
+
+} // namespace
+} // namespace inputhook
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2021 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+#include "TimerWheel.h"
+
+namespace inputhook {
+namespace {
+
+//! A timer that records when it fired so the test can compare it against when it should have
+struct TestTimer {
+    TimerWheel::Timer timer;
+    uint64_t expiry{};
+    uint64_t firedAt{};
+    int fired{};
+};
+
+class TimerWheelTest : public testing::Test {
+  protected:
+    TimerWheel mWheel;
+    std::vector<std::unique_ptr<TestTimer>> mTimers;
+    uint64_t mLastFired{};
+
+    TestTimer &Add(uint64_t delay) {
+        auto &test{*mTimers.emplace_back(std::make_unique<TestTimer>())};
+        test.timer.callback = [this, &test]() {
+            test.firedAt = mWheel.Now();
+            test.fired++;
+            EXPECT_GE(test.firedAt, mLastFired) << "Timers fired out of order";
+            mLastFired = test.firedAt;
+        };
+        test.expiry = mWheel.Now() + delay;
+        mWheel.Schedule(test.timer, delay);
+        return test;
+    }
+
+    //! Advances to |end| only ever stopping at the ticks NextWakeup asks for, like the reactor does
+    void RunUntil(uint64_t end) {
+        while (auto wakeup{mWheel.NextWakeup()}) {
+            ASSERT_GT(*wakeup, mWheel.Now());
+            if (*wakeup > end)
+                break;
+            mWheel.Advance(*wakeup);
+        }
+        mWheel.Advance(end);
+    }
+};
+
+TEST_F(TimerWheelTest, EmptyHasNoWakeup) {
+    EXPECT_FALSE(mWheel.NextWakeup());
+    mWheel.Advance(1000);
+    EXPECT_EQ(mWheel.Now(), 1000u);
+    EXPECT_FALSE(mWheel.NextWakeup());
+}
+
+TEST_F(TimerWheelTest, CascadesThroughEveryLevel) {
+    // The boundaries of every level and the longest possible delay
+    const uint64_t delays[]{1, 2, 63, 64, 65, 4095, 4096, 4097, 262143, 262144, 262145, TimerWheel::MaxDelay - 1, TimerWheel::MaxDelay};
+    for (auto delay : delays)
+        Add(delay);
+
+    RunUntil(TimerWheel::MaxDelay);
+
+    for (auto &test : mTimers) {
+        EXPECT_EQ(test->fired, 1) << "delay " << test->expiry;
+        EXPECT_EQ(test->firedAt, test->expiry);
+    }
+    EXPECT_FALSE(mWheel.NextWakeup());
+}
+
+TEST_F(TimerWheelTest, CascadesFromAnUnalignedStart) {
+    mWheel.Advance(262144 * 3 + 4096 * 5 + 64 * 7 + 11);
+    for (uint64_t delay{1}; delay < TimerWheel::MaxDelay; delay = delay * 3 + 1)
+        Add(delay);
+
+    mWheel.Advance(mWheel.Now() + TimerWheel::MaxDelay);
+
+    for (auto &test : mTimers) {
+        EXPECT_EQ(test->fired, 1);
+        EXPECT_EQ(test->firedAt, test->expiry);
+    }
+}
+
+TEST_F(TimerWheelTest, ClampsDelays) {
+    auto &zero{Add(0)};
+    auto &huge{Add(TimerWheel::MaxDelay * 4)};
+
+    mWheel.Advance(TimerWheel::MaxDelay);
+
+    EXPECT_EQ(zero.firedAt, 1u);
+    EXPECT_EQ(huge.firedAt, TimerWheel::MaxDelay);
+}
+
+TEST_F(TimerWheelTest, CancelAndReschedule) {
+    auto &cancelled{Add(100)};
+    auto &rescheduled{Add(5000)};
+    auto &kept{Add(300000)};
+
+    mWheel.Advance(50);
+    mWheel.Cancel(cancelled.timer);
+    EXPECT_FALSE(cancelled.timer.Pending());
+    mWheel.Cancel(cancelled.timer); // Cancelling twice is harmless
+
+    mWheel.Schedule(rescheduled.timer, 10);
+    rescheduled.expiry = 60;
+
+    mWheel.Advance(400000);
+
+    EXPECT_EQ(cancelled.fired, 0);
+    EXPECT_EQ(rescheduled.fired, 1);
+    EXPECT_EQ(rescheduled.firedAt, 60u);
+    EXPECT_EQ(kept.firedAt, 300000u);
+}
+
+TEST_F(TimerWheelTest, CallbacksCanReschedule) {
+    TimerWheel::Timer periodic;
+    std::vector<uint64_t> fired;
+    periodic.callback = [&]() {
+        fired.push_back(mWheel.Now());
+        if (fired.size() < 5)
+            mWheel.Schedule(periodic, 100);
+    };
+    mWheel.Schedule(periodic, 100);
+
+    RunUntil(10000);
+
+    EXPECT_EQ(fired, (std::vector<uint64_t>{100, 200, 300, 400, 500}));
+    EXPECT_FALSE(periodic.Pending());
+}
+
+TEST_F(TimerWheelTest, NextWakeupIsNeverLate) {
+    Add(10);
+    EXPECT_EQ(mWheel.NextWakeup(), 10u);
+
+    mWheel.Advance(10);
+    auto &far{Add(70000)};
+
+    // Long timers may need earlier wakeups for cascading, but never one past their expiry
+    int wakeups{};
+    while (auto wakeup{mWheel.NextWakeup()}) {
+        EXPECT_LE(*wakeup, far.expiry);
+        mWheel.Advance(*wakeup);
+        wakeups++;
+    }
+    EXPECT_EQ(far.firedAt, far.expiry);
+    EXPECT_LE(wakeups, TimerWheel::Levels); // One per level it cascades through rather than one per level 0 rotation
+}
+
+TEST_F(TimerWheelTest, ThousandsOfTimers) {
+    constexpr int Count{20000};
+    std::mt19937_64 random{42};
+    std::uniform_int_distribution<int> level{0, TimerWheel::Levels - 1};
+
+    auto start{std::chrono::steady_clock::now()};
+    for (int i{}; i < Count; i++) {
+        // Spread the delays evenly over the levels rather than the range, which would put nearly all of them on the top one
+        uint64_t limit{1ULL << (TimerWheel::SlotBits * (level(random) + 1))};
+        Add(std::uniform_int_distribution<uint64_t>{1, limit - 1}(random));
+    }
+    for (int i{}; i < Count; i += 3)
+        mWheel.Cancel(mTimers[i]->timer);
+    auto scheduled{std::chrono::steady_clock::now()};
+
+    // Advance in uneven steps so both skipping and single ticks are covered
+    std::uniform_int_distribution<uint64_t> step{1, 5000};
+    while (mWheel.NextWakeup())
+        mWheel.Advance(mWheel.Now() + step(random));
+    auto finished{std::chrono::steady_clock::now()};
+
+    for (int i{}; i < Count; i++) {
+        auto &test{*mTimers[i]};
+        if (i % 3 == 0) {
+            EXPECT_EQ(test.fired, 0);
+        } else {
+            EXPECT_EQ(test.fired, 1);
+            EXPECT_EQ(test.firedAt, test.expiry);
+        }
+    }
+
+    using std::chrono::nanoseconds;
+    RecordProperty("schedule_ns", std::to_string(std::chrono::duration_cast<nanoseconds>(scheduled - start).count() / Count));
+    RecordProperty("expire_ns", std::to_string(std::chrono::duration_cast<nanoseconds>(finished - scheduled).count() / Count));
+}
+
+} // namespace
+} // namespace inputhook